@@ -45,23 +45,30 @@ void writeIniFile(const std::string& filename, const IniSectionInput& iniData) {
     outFile.close();
 }
 
-// Update values in the INI data
-void updateIniData(IniSectionInput& iniData, const IniSectionInput& updates, bool remove=false) {
+// Update values in the INI data, returns false if nothing had to change
+bool updateIniData(IniSectionInput& iniData, const IniSectionInput& updates, bool remove=false) {
+    bool changed = false;
     if (remove) {
         for (const auto& [section, kvPairs] : updates) {
             for (const auto& [key, value] : kvPairs) {
             //log(iniData[section][key]);
-            iniData[section].erase(key);
+            changed = iniData[section].erase(key) > 0 || changed;
             }
         }
     } else {
         for (const auto& [section, kvPairs] : updates) {
             for (const auto& [key, value] : kvPairs) {
             //log(iniData[section][key]);
-            iniData[section][key] = value;
+            auto& current = iniData[section];
+            auto it = current.find(key);
+            if (it == current.end() || it->second != value) {
+                current[key] = value;
+                changed = true;
+            }
             }
         }
     }
+    return changed;
 }
 
 
@@ -49,7 +49,7 @@ public:
             textDataPair = dispCustData(kipInfoCommand[isFirstPage ? 1 : 2]);
         }
         else {
-            textDataPair = dispCustData(kipInfoCommand[isFirstPage ? 2 : 3], kipInfoCommand[1]);
+            textDataPair = dispCustData(kipInfoCommand[isFirstPage ? 2 : 3], getBackupViewPath(kipInfoCommand[1]));
         }
 
         std::string textdata = textDataPair.first;
@@ -74,13 +74,13 @@ public:
             return true;
         }
         if (showBackup && (keysDown & KEY_A)) {
-           copyFileOrDirectory(this->kipInfoCommand[1], "/atmosphere/kips/loader.kip");
+           restoreBackup(this->kipInfoCommand[1]);
            applied = true;
            tsl::goBack();
            return true;
         }
         if (showBackup && (keysDown & KEY_X)) {
-           deleteFileOrDirectory(this->kipInfoCommand[1]);
+           deleteBackup(this->kipInfoCommand[1]);
            tsl::goBack();
            applied = false;
            deleted = true;
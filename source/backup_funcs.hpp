@@ -0,0 +1,473 @@
+#pragma once
+#include <sys/stat.h>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "debug_funcs.hpp"
+#include "hash_funcs.hpp"
+#include "dir_funcs.hpp"
+#include "store_funcs.hpp"
+#include "glob_funcs.hpp"
+#include "path_funcs.hpp"
+
+// Backups of loader.kip, listed by number in an index. A backup is kept either as a full kip, "Backup [N].kip",
+// or as the bytes that differ from an older full one of the same size, "Backup [N].delta". A full backup that
+// only remains as the base of listed deltas is kept unlisted until none of them needs it.
+const std::string backupKipPath = "sdmc:/atmosphere/kips/loader.kip";
+const std::string backupDirectoryPath = "sdmc:/atmosphere/kips/.bak/";
+const std::string backupIndexPath = backupDirectoryPath + "index.txt";
+// Deltas are restored here under their backup's name, to be shown or used as {source}
+const std::string backupViewDirectory = contentStorePath + "backup/";
+
+struct BackupEntry {
+    int number;
+    long long size;
+    uint64_t hash;
+    int base; // Number of the full backup a delta applies to, its own number for a full one
+    bool listed;
+
+    bool isFull() const {
+        return base == number;
+    }
+};
+
+std::string getBackupFileName(int number, bool full) {
+    return "Backup [" + std::to_string(number) + (full ? "].kip" : "].delta");
+}
+
+std::string getBackupFilePath(const BackupEntry& entry) {
+    return backupDirectoryPath + getBackupFileName(entry.number, entry.isFull());
+}
+
+// Number of a "Backup [N].kip" or "Backup [N].delta" name or path, 0 if it isn't one
+int getBackupNumber(std::string_view name) {
+    const size_t slash = name.rfind('/');
+    if (slash != std::string_view::npos) {
+        name.remove_prefix(slash + 1);
+    }
+    const std::string_view prefix = "Backup [";
+    if (name.substr(0, prefix.size()) != prefix) {
+        return 0;
+    }
+    int number = 0;
+    size_t i = prefix.size();
+    for (; i < name.size() && i < prefix.size() + 9 && name[i] >= '0' && name[i] <= '9'; ++i) {
+        number = number * 10 + (name[i] - '0');
+    }
+    const std::string_view suffix = name.substr(i);
+    return (suffix == "].kip" || suffix == "].delta") ? number : 0;
+}
+
+bool readBackupFile(const std::string& filePath, std::string& data) {
+    FILE* file = fopen(filePath.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    struct stat fileInfo;
+    bool result = fstat(fileno(file), &fileInfo) == 0;
+    if (result) {
+        data.resize(fileInfo.st_size);
+        result = fread(data.data(), 1, data.size(), file) == data.size();
+    }
+    fclose(file);
+    return result;
+}
+
+bool writeBackupFile(const std::string& filePath, const std::string& data) {
+    FILE* file = fopen(filePath.c_str(), "wb");
+    if (!file) {
+        log("Failed to create \"%s\"", filePath.c_str());
+        return false;
+    }
+    const bool written = fwrite(data.data(), 1, data.size(), file) == data.size();
+    if (!(fclose(file) == 0 && written)) {
+        log("Failed to write \"%s\"", filePath.c_str());
+        std::remove(filePath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool saveBackupIndex(const std::vector<BackupEntry>& entries, int highestNumber);
+
+// Reads the index. While the backup directory is unchanged since the index was saved that is all, otherwise the
+// index is brought in line with the directory and saved: full backups put there by hand are added, entries
+// whose file is gone are dropped, and so are deltas whose base is gone, together with their file.
+// Entries are sorted by number. highestNumber is set to the highest number of any backup file in the directory.
+std::vector<BackupEntry> loadBackupIndex(int* highestNumber = nullptr) {
+    std::vector<BackupEntry> entries;
+    long long savedDirectoryTime = -1;
+    int savedHighestNumber = 0;
+    FILE* file = fopen(backupIndexPath.c_str(), "r");
+    if (file) {
+        // number<TAB>size<TAB>hash<TAB>base<TAB>listed, and #directory<TAB>mtime<TAB>highest number when saved
+        char line[256];
+        while (fgets(line, sizeof(line), file)) {
+            int number, base, listed;
+            long long size;
+            unsigned long long hash;
+            if (sscanf(line, "%d\t%lld\t%llx\t%d\t%d", &number, &size, &hash, &base, &listed) == 5 && number > 0) {
+                entries.push_back({number, size, static_cast<uint64_t>(hash), base, listed != 0});
+            } else if (sscanf(line, "#directory\t%lld\t%d", &size, &number) == 2) {
+                savedDirectoryTime = size;
+                savedHighestNumber = number;
+            }
+        }
+        fclose(file);
+    }
+    struct stat directoryInfo;
+    if (savedDirectoryTime >= 0 && stat(backupDirectoryPath.c_str(), &directoryInfo) == 0 && directoryInfo.st_mtime == savedDirectoryTime) {
+        if (highestNumber) {
+            *highestNumber = savedHighestNumber;
+        }
+        return entries;
+    }
+    std::map<int, bool> files; // Number to whether it is a full backup
+    auto snapshot = getDirectorySnapshot(backupDirectoryPath);
+    if (snapshot) {
+        for (const auto& entry : snapshot->entries) {
+            const std::string_view name = snapshot->name(entry);
+            const int number = entry.isDirectory ? 0 : getBackupNumber(name);
+            if (number > 0) {
+                files[number] = name.substr(name.size() - 4) == ".kip";
+            }
+        }
+    }
+    const int directoryHighestNumber = files.empty() ? 0 : files.rbegin()->first;
+    if (highestNumber) {
+        *highestNumber = directoryHighestNumber;
+    }
+
+    entries.erase(std::remove_if(entries.begin(), entries.end(), [&](const BackupEntry& entry) {
+        auto it = files.find(entry.number);
+        return it == files.end() || it->second != entry.isFull();
+    }), entries.end());
+    std::set<int> fullBackups;
+    for (const auto& entry : entries) {
+        if (entry.isFull()) {
+            fullBackups.insert(entry.number);
+        }
+    }
+    bool removedDeltas = false;
+    entries.erase(std::remove_if(entries.begin(), entries.end(), [&](const BackupEntry& entry) {
+        if (entry.isFull() || fullBackups.count(entry.base) != 0) {
+            return false;
+        }
+        // Without its base the delta can't be restored
+        std::remove(getBackupFilePath(entry).c_str());
+        removedDeltas = true;
+        return true;
+    }), entries.end());
+    if (removedDeltas) {
+        clearDirectoryCache();
+    }
+
+    for (const auto& [number, full] : files) {
+        if (!full || fullBackups.count(number) != 0) {
+            continue;
+        }
+        BackupEntry entry{number, 0, 0, number, true};
+        const std::string filePath = getBackupFilePath(entry);
+        struct stat fileInfo;
+        if (stat(filePath.c_str(), &fileInfo) == 0 && getContentHash(filePath, fileInfo, entry.hash)) {
+            entry.size = fileInfo.st_size;
+            entries.push_back(entry);
+        }
+    }
+    std::sort(entries.begin(), entries.end(), [](const BackupEntry& a, const BackupEntry& b) {
+        return a.number < b.number;
+    });
+    if (snapshot) {
+        // Reconciled once per change of the directory
+        saveBackupIndex(entries, directoryHighestNumber);
+    }
+    return entries;
+}
+
+// Every change to the backups ends here, so this is where listings of the directory go stale. The directory's
+// mtime is recorded after the index is written, which doesn't change it again.
+bool saveBackupIndex(const std::vector<BackupEntry>& entries, int highestNumber) {
+    clearDirectoryCache();
+    FILE* file = fopen(backupIndexPath.c_str(), "w");
+    if (!file) {
+        log("Failed to write \"%s\"", backupIndexPath.c_str());
+        return false;
+    }
+    for (const auto& entry : entries) {
+        fprintf(file, "%d\t%lld\t%016llx\t%d\t%d\n", entry.number, entry.size, static_cast<unsigned long long>(entry.hash), entry.base, entry.listed ? 1 : 0);
+        highestNumber = std::max(highestNumber, entry.number);
+    }
+    if (fclose(file) != 0) {
+        return false;
+    }
+    struct stat directoryInfo;
+    if (stat(backupDirectoryPath.c_str(), &directoryInfo) == 0) {
+        file = fopen(backupIndexPath.c_str(), "a");
+        if (file) {
+            fprintf(file, "#directory\t%lld\t%d\n", static_cast<long long>(directoryInfo.st_mtime), highestNumber);
+            fclose(file);
+        }
+    }
+    return true;
+}
+
+// A delta file starts with the magic, the size and hash of the kip, followed by runs of
+// 32-bit offset, 32-bit length and the bytes that replace those of the base
+const char backupDeltaMagic[8] = {'U', 'H', 'D', 'E', 'L', 'T', 'A', '1'};
+// Differences fewer equal bytes apart than this share a run
+constexpr size_t backupDeltaGap = 8;
+
+void appendBackupValue(std::string& data, const void* value, size_t size) {
+    data.append(static_cast<const char*>(value), size);
+}
+
+std::string makeBackupDelta(const std::string& base, const std::string& target) {
+    std::string delta(backupDeltaMagic, sizeof(backupDeltaMagic));
+    const uint64_t size = target.size();
+    const uint64_t hash = fnv1aHash(target.data(), target.size());
+    appendBackupValue(delta, &size, sizeof(size));
+    appendBackupValue(delta, &hash, sizeof(hash));
+
+    size_t i = 0;
+    while (i < target.size()) {
+        if (i < base.size() && base[i] == target[i]) {
+            ++i;
+            continue;
+        }
+        size_t end = i + 1, equal = 0;
+        for (size_t j = i + 1; j < target.size() && equal < backupDeltaGap; ++j) {
+            if (j < base.size() && base[j] == target[j]) {
+                ++equal;
+            } else {
+                equal = 0;
+                end = j + 1;
+            }
+        }
+        const uint32_t runOffset = i, runLength = end - i;
+        appendBackupValue(delta, &runOffset, sizeof(runOffset));
+        appendBackupValue(delta, &runLength, sizeof(runLength));
+        delta.append(target, i, runLength);
+        i = end;
+    }
+    return delta;
+}
+
+bool applyBackupDelta(const std::string& base, const std::string& delta, std::string& target) {
+    uint64_t size, hash;
+    const size_t headerSize = sizeof(backupDeltaMagic) + sizeof(size) + sizeof(hash);
+    if (delta.size() < headerSize || std::memcmp(delta.data(), backupDeltaMagic, sizeof(backupDeltaMagic)) != 0) {
+        return false;
+    }
+    std::memcpy(&size, delta.data() + sizeof(backupDeltaMagic), sizeof(size));
+    std::memcpy(&hash, delta.data() + sizeof(backupDeltaMagic) + sizeof(size), sizeof(hash));
+
+    target = base;
+    target.resize(size);
+    size_t position = headerSize;
+    while (position < delta.size()) {
+        uint32_t runOffset, runLength;
+        if (delta.size() - position < sizeof(runOffset) + sizeof(runLength)) {
+            return false;
+        }
+        std::memcpy(&runOffset, delta.data() + position, sizeof(runOffset));
+        std::memcpy(&runLength, delta.data() + position + sizeof(runOffset), sizeof(runLength));
+        position += sizeof(runOffset) + sizeof(runLength);
+        if (delta.size() - position < runLength || runOffset > size || size - runOffset < runLength) {
+            return false;
+        }
+        target.replace(runOffset, runLength, delta, position, runLength);
+        position += runLength;
+    }
+    return fnv1aHash(target.data(), target.size()) == hash;
+}
+
+// Contents of a backup, a delta is applied to its base
+bool readBackup(const BackupEntry& entry, std::string& data) {
+    if (entry.isFull()) {
+        return readBackupFile(getBackupFilePath(entry), data);
+    }
+    std::string base, delta;
+    const BackupEntry baseEntry{entry.base, 0, 0, entry.base, false};
+    if (!readBackupFile(getBackupFilePath(baseEntry), base) || !readBackupFile(getBackupFilePath(entry), delta) || !applyBackupDelta(base, delta, data)) {
+        log("Failed to read \"%s\"", getBackupFilePath(entry).c_str());
+        return false;
+    }
+    return true;
+}
+
+// Unlists the oldest backups beyond keep (0 keeps all), then deletes the unlisted ones no listed delta needs
+void pruneBackups(std::vector<BackupEntry>& entries, int keep) {
+    if (keep > 0) {
+        int listedCount = std::count_if(entries.begin(), entries.end(), [](const BackupEntry& entry) {
+            return entry.listed;
+        });
+        for (auto& entry : entries) {
+            if (listedCount <= keep) {
+                break;
+            }
+            if (entry.listed) {
+                entry.listed = false;
+                --listedCount;
+            }
+        }
+    }
+    std::set<int> neededBases;
+    for (const auto& entry : entries) {
+        if (entry.listed && !entry.isFull()) {
+            neededBases.insert(entry.base);
+        }
+    }
+    entries.erase(std::remove_if(entries.begin(), entries.end(), [&](const BackupEntry& entry) {
+        if (entry.listed || neededBases.count(entry.number) != 0) {
+            return false;
+        }
+        std::remove(getBackupFilePath(entry).c_str());
+        return true;
+    }), entries.end());
+}
+
+// The index entry of a backup path as listed by listBackups, or nullptr if the path isn't a managed backup
+BackupEntry* findBackup(std::vector<BackupEntry>& entries, const std::string& backupPath) {
+    const std::string path = preprocessPath(backupPath);
+    if (getParentDirFromPath(path) != backupDirectoryPath) {
+        return nullptr;
+    }
+    const int number = getBackupNumber(path);
+    for (auto& entry : entries) {
+        if (entry.number == number && entry.listed) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+// Backs up the current loader.kip unless a listed backup already holds the same kip, keeping the newest keep backups
+bool generateBackup(int keep = 0) {
+    std::string kip;
+    if (!readBackupFile(backupKipPath, kip)) {
+        log("Failed to read \"%s\"", backupKipPath.c_str());
+        return false;
+    }
+    createDirectory(backupDirectoryPath);
+    int highestNumber;
+    std::vector<BackupEntry> entries = loadBackupIndex(&highestNumber);
+
+    const uint64_t hash = fnv1aHash(kip.data(), kip.size());
+    for (const auto& entry : entries) {
+        if (entry.listed && entry.size == static_cast<long long>(kip.size()) && entry.hash == hash) {
+            // The current kip is backed up already, another copy would only take space
+            return true;
+        }
+    }
+
+    // Numbers of files left behind by removed or dropped backups aren't taken again
+    BackupEntry backup{std::max(highestNumber, entries.empty() ? 0 : entries.back().number) + 1, static_cast<long long>(kip.size()), hash, 0, true};
+    backup.base = backup.number;
+    // Kips built for the same loader differ in a few values, so the newest full backup of the same size is the base
+    auto base = std::find_if(entries.rbegin(), entries.rend(), [&](const BackupEntry& entry) {
+        return entry.isFull() && entry.size == backup.size;
+    });
+    std::string baseData;
+    if (base != entries.rend() && readBackupFile(getBackupFilePath(*base), baseData)) {
+        const std::string delta = makeBackupDelta(baseData, kip);
+        if (delta.size() < kip.size() / 4) {
+            backup.base = base->number;
+            if (!writeBackupFile(getBackupFilePath(backup), delta)) {
+                return false;
+            }
+        }
+    }
+    if (backup.isFull() && !writeBackupFile(getBackupFilePath(backup), kip)) {
+        return false;
+    }
+
+    entries.push_back(backup);
+    pruneBackups(entries, keep);
+    return saveBackupIndex(entries, backup.number);
+}
+
+bool isBackupPath(const std::string& path) {
+    return startsWith(preprocessPath(path), backupDirectoryPath);
+}
+
+// True if pathPattern names the backup kips, as in "/atmosphere/kips/.bak/*" or ".../*.kip"
+bool isBackupListPattern(const std::string& pathPattern) {
+    const size_t slash = pathPattern.find_last_of('/');
+    if (slash == std::string::npos || preprocessPath(pathPattern.substr(0, slash + 1)) != backupDirectoryPath) {
+        return false;
+    }
+    const GlobPattern glob = compileGlob(pathPattern.substr(slash + 1));
+    return glob.levels.size() == 1 && !glob.levels[0].recursive && matchGlobLevel(glob.levels[0], getBackupFileName(1, true));
+}
+
+// Paths of the listed backups that pathPattern matches and exclusions don't, by number. Deltas are listed
+// under the name of the kip they stand for. The paths start like pathPattern, so filters written for the
+// files on the card apply to them.
+std::vector<std::string> listBackups(const std::string& pathPattern, const GlobExclusions& exclusions = GlobExclusions()) {
+    std::vector<std::string> backupPaths;
+    const size_t slash = pathPattern.find_last_of('/');
+    const std::string directory = pathPattern.substr(0, slash + 1);
+    const GlobPattern glob = compileGlob(pathPattern.substr(slash + 1));
+    if (glob.levels.size() != 1) {
+        return backupPaths;
+    }
+    for (const auto& entry : loadBackupIndex()) {
+        const std::string name = getBackupFileName(entry.number, true);
+        if (entry.listed && matchGlobLevel(glob.levels[0], name) && !exclusions.excludes(directory + name)) {
+            backupPaths.push_back(directory + name);
+        }
+    }
+    return backupPaths;
+}
+
+// Writes a backup to toPath. Paths that aren't managed backups are copied as they are.
+bool restoreBackup(const std::string& backupPath, const std::string& toPath = backupKipPath) {
+    std::vector<BackupEntry> entries = loadBackupIndex();
+    const BackupEntry* entry = findBackup(entries, backupPath);
+    if (entry == nullptr || entry->isFull()) {
+        const bool result = copyFileOrDirectory(preprocessPath(backupPath), toPath);
+        // Restores run outside of a command run, which would release the buffers otherwise
+        releaseCopyBuffers();
+        return result;
+    }
+    std::string kip;
+    return readBackup(*entry, kip) && writeBackupFile(toPath, kip);
+}
+
+// Path of a file holding the backup's kip, for reading or copying it in place. A delta is written out in full
+// under the backup's own name, which replaces the one written before.
+std::string getBackupViewPath(const std::string& backupPath) {
+    if (!isBackupPath(backupPath)) {
+        return backupPath;
+    }
+    std::vector<BackupEntry> entries = loadBackupIndex();
+    const BackupEntry* entry = findBackup(entries, backupPath);
+    if (entry == nullptr || entry->isFull()) {
+        return backupPath;
+    }
+    const std::string viewPath = backupViewDirectory + getBackupFileName(entry->number, true);
+    std::string kip;
+    deleteFileOrDirectory(backupViewDirectory);
+    createDirectory(backupViewDirectory);
+    if (!readBackup(*entry, kip) || !writeBackupFile(viewPath, kip)) {
+        return backupPath;
+    }
+    return viewPath;
+}
+
+bool deleteBackup(const std::string& backupPath) {
+    int highestNumber;
+    std::vector<BackupEntry> entries = loadBackupIndex(&highestNumber);
+    BackupEntry* entry = findBackup(entries, backupPath);
+    if (entry == nullptr) {
+        return deleteFileOrDirectory(preprocessPath(backupPath));
+    }
+    entry->listed = false;
+    pruneBackups(entries, 0);
+    return saveBackupIndex(entries, highestNumber);
+}
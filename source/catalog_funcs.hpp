@@ -0,0 +1,358 @@
+#pragma once
+#include <sys/stat.h>
+#include <dirent.h>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <cctype>
+#include <memory>
+#include <unordered_map>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "debug_funcs.hpp"
+#include "hash_funcs.hpp"
+#include "json_funcs.hpp"
+#include "store_funcs.hpp"
+#include "path_funcs.hpp"
+
+// Package JSON lists compiled into a binary catalog: the requested string members of each element (see
+// readJsonTable), their text and a hash index on the members the current value is matched against. A catalog
+// is kept in the store per JSON file and set of members, under a name that stays the same while the JSON changes.
+// It is read back with one fread while the JSON's content hash is the one it was made from, otherwise it is
+// compiled again. Catalogs of JSON files that are gone are removed whenever a catalog is written.
+const std::string catalogDirectoryPath = contentStorePath + "catalogs/";
+const char catalogMagic[8] = {'U', 'H', 'C', 'A', 'T', '0', '3', '\0'};
+// Members the current value of a list is looked up by. Hex values match regardless of case.
+const std::vector<std::string> catalogMatchKeys = {"hex", "dec", "value"};
+
+struct CatalogHeader {
+    char magic[8];
+    uint64_t sourceHash;
+    uint32_t columnCount;
+    uint32_t columnNamesSize; // Names, each ending with '\0'
+    uint32_t rowCount;
+    uint32_t bucketCount;
+    uint32_t textSize;
+    uint32_t sourcePathSize; // The JSON's path follows the column names
+};
+
+struct Catalog {
+    JsonTable table;
+    std::vector<uint32_t> buckets; // Row + 1 of the first row with a value, 0 for an empty bucket
+
+    bool isFolded(size_t column) const {
+        return table.columns[column] == "hex";
+    }
+
+    static uint64_t hashValue(size_t column, std::string_view value, bool folded) {
+        const unsigned char columnByte = static_cast<unsigned char>(column);
+        uint64_t hash = fnv1aHash(&columnByte, 1);
+        for (char character : value) {
+            if (folded && character >= 'a' && character <= 'z') {
+                character = character - 'a' + 'A';
+            }
+            hash = fnv1aHash(&character, 1, hash);
+        }
+        return hash;
+    }
+
+    static bool sameValue(std::string_view a, std::string_view b, bool folded) {
+        if (!folded) {
+            return a == b;
+        }
+        return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+            return std::toupper(static_cast<unsigned char>(x)) == std::toupper(static_cast<unsigned char>(y));
+        });
+    }
+
+    // First row whose column holds value, or -1. Only columns named in catalogMatchKeys are indexed.
+    long find(size_t column, std::string_view value) const {
+        if (buckets.empty()) {
+            return -1;
+        }
+        const bool folded = isFolded(column);
+        const size_t mask = buckets.size() - 1;
+        size_t bucket = hashValue(column, value, folded) & mask;
+        for (size_t probe = 0; probe < buckets.size() && buckets[bucket] != 0; ++probe, bucket = (bucket + 1) & mask) {
+            const size_t row = buckets[bucket] - 1;
+            if (table.has(row, column) && sameValue(table.get(row, column), value, folded)) {
+                return static_cast<long>(row);
+            }
+        }
+        return -1;
+    }
+
+    void buildIndex() {
+        std::vector<bool> indexed(table.columns.size());
+        size_t entries = 0;
+        for (size_t column = 0; column < table.columns.size(); ++column) {
+            indexed[column] = std::find(catalogMatchKeys.begin(), catalogMatchKeys.end(), table.columns[column]) != catalogMatchKeys.end();
+            entries += indexed[column] ? table.rows : 0;
+        }
+        buckets.clear();
+        if (entries == 0) {
+            return;
+        }
+        size_t bucketCount = 16;
+        while (bucketCount < entries * 2) {
+            bucketCount *= 2;
+        }
+        buckets.assign(bucketCount, 0);
+        const size_t mask = bucketCount - 1;
+        for (size_t row = 0; row < table.rows; ++row) {
+            for (size_t column = 0; column < table.columns.size(); ++column) {
+                if (!indexed[column] || !table.has(row, column)) {
+                    continue;
+                }
+                const std::string_view value = table.get(row, column);
+                if (find(column, value) >= 0) {
+                    // An earlier row has it, lookups return that one
+                    continue;
+                }
+                size_t bucket = hashValue(column, value, isFolded(column)) & mask;
+                while (buckets[bucket] != 0) {
+                    bucket = (bucket + 1) & mask;
+                }
+                buckets[bucket] = row + 1;
+            }
+        }
+    }
+};
+
+std::string getCatalogPath(const std::string& jsonPath, const std::vector<std::string>& columns) {
+    uint64_t hash = fnv1aHash(jsonPath);
+    for (const auto& column : columns) {
+        hash = fnv1aHash(column.c_str(), column.size() + 1, hash);
+    }
+    return catalogDirectoryPath + hashToHex(hash) + ".bin";
+}
+
+template <typename T>
+void appendCatalogData(std::string& data, const T* values, size_t count) {
+    data.append(reinterpret_cast<const char*>(values), count * sizeof(T));
+}
+
+bool writeCatalog(const std::string& catalogPath, const Catalog& catalog, const std::string& sourcePath, uint64_t sourceHash) {
+    const JsonTable& table = catalog.table;
+    std::string columnNames;
+    for (const auto& column : table.columns) {
+        columnNames.append(column.c_str(), column.size() + 1);
+    }
+    CatalogHeader header{};
+    std::memcpy(header.magic, catalogMagic, sizeof(header.magic));
+    header.sourceHash = sourceHash;
+    header.columnCount = table.columns.size();
+    header.columnNamesSize = columnNames.size();
+    header.rowCount = table.rows;
+    header.bucketCount = catalog.buckets.size();
+    header.textSize = table.text.size();
+    header.sourcePathSize = sourcePath.size();
+
+    std::string data;
+    data.reserve(sizeof(header) + columnNames.size() + sourcePath.size() + table.offsets.size() * 8 + catalog.buckets.size() * 4 + table.text.size());
+    appendCatalogData(data, &header, 1);
+    data += columnNames;
+    data += sourcePath;
+    appendCatalogData(data, table.offsets.data(), table.offsets.size());
+    appendCatalogData(data, table.lengths.data(), table.lengths.size());
+    appendCatalogData(data, catalog.buckets.data(), catalog.buckets.size());
+    data += table.text;
+
+    createDirectory(catalogDirectoryPath);
+    FILE* file = fopen(catalogPath.c_str(), "wb");
+    if (!file) {
+        log("Failed to create \"%s\"", catalogPath.c_str());
+        return false;
+    }
+    const bool written = fwrite(data.data(), 1, data.size(), file) == data.size();
+    if (!(fclose(file) == 0 && written)) {
+        log("Failed to write \"%s\"", catalogPath.c_str());
+        std::remove(catalogPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Reads a catalog made from the source with sourceHash for the given columns. False if there is none.
+bool readCatalog(const std::string& catalogPath, const std::vector<std::string>& columns, uint64_t sourceHash, Catalog& catalog) {
+    FILE* file = fopen(catalogPath.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    struct stat fileInfo;
+    std::string data;
+    bool result = fstat(fileno(file), &fileInfo) == 0 && static_cast<size_t>(fileInfo.st_size) >= sizeof(CatalogHeader);
+    if (result) {
+        data.resize(fileInfo.st_size);
+        result = fread(data.data(), 1, data.size(), file) == data.size();
+    }
+    fclose(file);
+    if (!result) {
+        return false;
+    }
+
+    CatalogHeader header;
+    std::memcpy(&header, data.data(), sizeof(header));
+    const uint64_t cells = static_cast<uint64_t>(header.rowCount) * header.columnCount;
+    if (std::memcmp(header.magic, catalogMagic, sizeof(header.magic)) != 0 || header.sourceHash != sourceHash || header.columnCount != columns.size()
+        || data.size() != sizeof(header) + header.columnNamesSize + header.sourcePathSize + cells * 8 + header.bucketCount * 4ULL + header.textSize) {
+        return false;
+    }
+    size_t position = sizeof(header);
+    for (const auto& column : columns) {
+        if (position + column.size() >= sizeof(header) + header.columnNamesSize || data.compare(position, column.size() + 1, column.c_str(), column.size() + 1) != 0) {
+            return false;
+        }
+        position += column.size() + 1;
+    }
+    if (position != sizeof(header) + header.columnNamesSize) {
+        return false;
+    }
+    position += header.sourcePathSize;
+
+    JsonTable& table = catalog.table;
+    table.columns = columns;
+    table.rows = header.rowCount;
+    table.offsets.resize(cells);
+    table.lengths.resize(cells);
+    catalog.buckets.resize(header.bucketCount);
+    std::memcpy(table.offsets.data(), data.data() + position, cells * 4);
+    position += cells * 4;
+    std::memcpy(table.lengths.data(), data.data() + position, cells * 4);
+    position += cells * 4;
+    std::memcpy(catalog.buckets.data(), data.data() + position, header.bucketCount * 4ULL);
+    position += header.bucketCount * 4ULL;
+    table.text.assign(data, position, header.textSize);
+
+    // A damaged file must not point outside the text
+    for (size_t cell = 0; cell < cells; ++cell) {
+        if (table.offsets[cell] != JsonTable::missing && static_cast<uint64_t>(table.offsets[cell]) + table.lengths[cell] > header.textSize) {
+            return false;
+        }
+    }
+    for (const uint32_t bucket : catalog.buckets) {
+        if (bucket > header.rowCount) {
+            return false;
+        }
+    }
+    return (header.bucketCount & (header.bucketCount - 1)) == 0;
+}
+
+// Removes the catalogs whose JSON file is gone, and files that aren't catalogs of this version
+void pruneCatalogs() {
+    DIR* dir = opendir(catalogDirectoryPath.c_str());
+    if (!dir) {
+        return;
+    }
+    std::vector<std::string> catalogPaths;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        if (entry->d_type == DT_REG) {
+            catalogPaths.push_back(catalogDirectoryPath + entry->d_name);
+        }
+    }
+    closedir(dir);
+
+    for (const auto& catalogPath : catalogPaths) {
+        FILE* file = fopen(catalogPath.c_str(), "rb");
+        if (!file) {
+            continue;
+        }
+        CatalogHeader header;
+        std::string sourcePath;
+        bool valid = fread(&header, sizeof(header), 1, file) == 1 && std::memcmp(header.magic, catalogMagic, sizeof(header.magic)) == 0
+            && fseek(file, header.columnNamesSize, SEEK_CUR) == 0;
+        if (valid) {
+            sourcePath.resize(header.sourcePathSize);
+            valid = fread(sourcePath.data(), 1, sourcePath.size(), file) == sourcePath.size();
+        }
+        fclose(file);
+        struct stat sourceInfo;
+        if (!valid || stat(sourcePath.c_str(), &sourceInfo) != 0) {
+            std::remove(catalogPath.c_str());
+        }
+    }
+}
+
+// The catalog of jsonPath for the given columns, read from the store or compiled and stored if the JSON changed
+bool loadCatalog(const std::string& jsonPath, const std::vector<std::string>& columns, Catalog& catalog) {
+    catalog = Catalog();
+    struct stat jsonInfo;
+    uint64_t sourceHash;
+    if (stat(jsonPath.c_str(), &jsonInfo) != 0 || !getContentHash(jsonPath, jsonInfo, sourceHash)) {
+        log("ERROR: loadCatalog: failed to read \"%s\"", jsonPath.c_str());
+        return false;
+    }
+    const std::string catalogPath = getCatalogPath(jsonPath, columns);
+    if (readCatalog(catalogPath, columns, sourceHash, catalog)) {
+        return true;
+    }
+    if (!readJsonTable(jsonPath, columns, catalog.table)) {
+        return false;
+    }
+    catalog.buildIndex();
+    if (writeCatalog(catalogPath, catalog, jsonPath, sourceHash)) {
+        pruneCatalogs();
+    }
+    saveContentIndex();
+    return true;
+}
+
+// Catalogs in use stay loaded, so the menu items and overlays that show the same list share one
+struct LoadedCatalog {
+    off_t size;
+    time_t mtime;
+    std::shared_ptr<const Catalog> catalog;
+    uint64_t lastUse;
+};
+
+std::unordered_map<std::string, LoadedCatalog> loadedCatalogs; // By catalog path
+Mutex loadedCatalogsMutex;
+uint64_t loadedCatalogsClock = 0;
+const size_t loadedCatalogLimit = 8;
+
+// Menus clear the loaded catalogs when they close, catalogs still held by an element stay alive until it goes
+void clearLoadedCatalogs() {
+    mutexLock(&loadedCatalogsMutex);
+    loadedCatalogs.clear();
+    mutexUnlock(&loadedCatalogsMutex);
+}
+
+// Like loadCatalog, but a catalog already loaded is returned as long as the JSON's size and mtime are unchanged.
+// nullptr if the JSON can't be read as a list.
+std::shared_ptr<const Catalog> getCatalog(const std::string& jsonPath, const std::vector<std::string>& columns) {
+    struct stat jsonInfo;
+    if (stat(jsonPath.c_str(), &jsonInfo) != 0) {
+        return nullptr;
+    }
+    const std::string catalogPath = getCatalogPath(jsonPath, columns);
+    mutexLock(&loadedCatalogsMutex);
+    auto it = loadedCatalogs.find(catalogPath);
+    if (it != loadedCatalogs.end() && it->second.size == jsonInfo.st_size && it->second.mtime == jsonInfo.st_mtime) {
+        it->second.lastUse = ++loadedCatalogsClock;
+        auto catalog = it->second.catalog;
+        mutexUnlock(&loadedCatalogsMutex);
+        return catalog;
+    }
+    mutexUnlock(&loadedCatalogsMutex);
+
+    auto catalog = std::make_shared<Catalog>();
+    if (!loadCatalog(jsonPath, columns, *catalog)) {
+        return nullptr;
+    }
+
+    mutexLock(&loadedCatalogsMutex);
+    if (loadedCatalogs.find(catalogPath) == loadedCatalogs.end() && loadedCatalogs.size() >= loadedCatalogLimit) {
+        auto oldest = loadedCatalogs.begin();
+        for (auto entry = loadedCatalogs.begin(); entry != loadedCatalogs.end(); ++entry) {
+            if (entry->second.lastUse < oldest->second.lastUse) {
+                oldest = entry;
+            }
+        }
+        loadedCatalogs.erase(oldest);
+    }
+    loadedCatalogs[catalogPath] = {jsonInfo.st_size, jsonInfo.st_mtime, catalog, ++loadedCatalogsClock};
+    mutexUnlock(&loadedCatalogsMutex);
+    return catalog;
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include <dirent.h>
+#include <sys/stat.h>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Directory listings are kept in memory and served again while the directory's mtime is unchanged.
+// Commands that may change the SD card clear the cache, as FAT doesn't always update directory times.
+struct DirectorySnapshot {
+    struct Entry {
+        uint32_t nameOffset;
+        uint16_t nameLength;
+        bool isDirectory;
+    };
+
+    time_t mtime = 0;
+    std::string names; // All names back to back
+    std::vector<Entry> entries;
+
+    std::string_view name(const Entry& entry) const {
+        return std::string_view(names).substr(entry.nameOffset, entry.nameLength);
+    }
+};
+
+// Snapshots are shared between the UI and the interpreter thread
+std::unordered_map<std::string, std::shared_ptr<const DirectorySnapshot>> directoryCache;
+Mutex directoryCacheMutex;
+const size_t directoryCacheLimit = 256;
+
+// Directories createDirectory made or found, without a trailing slash. Cleared along with the listings
+// and whenever a directory is deleted or moved away.
+std::unordered_set<std::string> createdDirectories;
+
+void clearDirectoryCache() {
+    mutexLock(&directoryCacheMutex);
+    directoryCache.clear();
+    createdDirectories.clear();
+    mutexUnlock(&directoryCacheMutex);
+}
+
+void forgetCreatedDirectories() {
+    mutexLock(&directoryCacheMutex);
+    createdDirectories.clear();
+    mutexUnlock(&directoryCacheMutex);
+}
+
+// Returns the entries of directoryPath without "." and "..", or nullptr if it isn't a readable directory
+std::shared_ptr<const DirectorySnapshot> getDirectorySnapshot(const std::string& directoryPath) {
+    if (directoryPath.empty()) {
+        return nullptr;
+    }
+    std::string key = directoryPath;
+    if (key.back() != '/') {
+        key += '/';
+    }
+
+    struct stat directoryInfo;
+    if (stat(key.c_str(), &directoryInfo) != 0 || !S_ISDIR(directoryInfo.st_mode)) {
+        return nullptr;
+    }
+
+    mutexLock(&directoryCacheMutex);
+    auto it = directoryCache.find(key);
+    if (it != directoryCache.end() && it->second->mtime == directoryInfo.st_mtime) {
+        auto snapshot = it->second;
+        mutexUnlock(&directoryCacheMutex);
+        return snapshot;
+    }
+    mutexUnlock(&directoryCacheMutex);
+
+    DIR* dir = opendir(key.c_str());
+    if (dir == nullptr) {
+        return nullptr;
+    }
+    auto snapshot = std::make_shared<DirectorySnapshot>();
+    snapshot->mtime = directoryInfo.st_mtime;
+    dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        const std::string_view entryName = entry->d_name;
+        if (entryName == "." || entryName == "..") {
+            continue;
+        }
+        bool isEntryDirectory;
+        if (entry->d_type == DT_DIR || entry->d_type == DT_REG) {
+            isEntryDirectory = (entry->d_type == DT_DIR);
+        } else {
+            // No type from readdir (or a link), ask stat
+            struct stat entryInfo;
+            isEntryDirectory = stat((key + entry->d_name).c_str(), &entryInfo) == 0 && S_ISDIR(entryInfo.st_mode);
+        }
+        snapshot->entries.push_back({static_cast<uint32_t>(snapshot->names.size()), static_cast<uint16_t>(entryName.size()), isEntryDirectory});
+        snapshot->names += entryName;
+    }
+    closedir(dir);
+
+    mutexLock(&directoryCacheMutex);
+    if (directoryCache.size() >= directoryCacheLimit) {
+        directoryCache.clear();
+    }
+    directoryCache[key] = snapshot;
+    mutexUnlock(&directoryCacheMutex);
+    return snapshot;
+}
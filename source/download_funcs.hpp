@@ -140,6 +140,8 @@ bool downloadFile(const std::string& url, const std::string& toDestination, tsl:
         log("Error opening file: %s", destination.c_str());
         return false;
     }
+    // A cached document of the old file is stale now
+    forgetJsonDocument(destination);
     struct progress data;
     data.listItem = listItem;
     data.totalCommands = totalCommands;
@@ -231,18 +233,16 @@ bool unzipFile(const std::string& zipFilePath, const std::string& toDestination,
         } else {
             directoryPath = extractedFilePath;
         }
-        createDirectory(directoryPath);
+        if (!createDirectory(directoryPath)) {
+            // Logging failure to create directory
+            log("Failed to create directory path: %s", directoryPath.c_str());
+        }
 
         // Check if the file is a directory
-        if (isDirectory(extractedFilePath)) {
+        if (extractedFilePath.back() == '/' || isDirectory(extractedFilePath)) {
             continue;
         }
 
-        if (!isDirectory(directoryPath)) {
-            // Logging failure to create directory
-            log("Failed to create directory path: %s", directoryPath.c_str());
-        }
-
         ZZIP_FILE* file = zzip_file_open(dir, entry.d_name, 0);
         if (file) {
             FILE* outputFile = fopen(extractedFilePath.c_str(), "wb");
@@ -2,11 +2,13 @@
 
 #include "debug_funcs.hpp"
 #include "json_funcs.hpp"
+#include <cstring>
 #include <dirent.h>
-#include <fnmatch.h>
 #include <jansson.h>
 #include <regex>
 #include <string_funcs.hpp>
+#include <dir_funcs.hpp>
+#include <glob_funcs.hpp>
 #include <sys/stat.h>
 
 // Get functions
@@ -150,6 +152,38 @@ std::string getParentDirNameFromPath(const std::string& path) {
     return "";
 }
 
+// Sorts paths by their names in natural order (see getCollationKey), plain names work too. With byParent
+// they are grouped by the name of their parent directory first. Keys are made once per path, not per comparison.
+void sortPathsByName(std::vector<std::string>& paths, bool byParent = false) {
+    struct SortEntry {
+        std::string key;
+        size_t index;
+    };
+    std::vector<SortEntry> entries;
+    entries.reserve(paths.size());
+    for (size_t i = 0; i < paths.size(); ++i) {
+        std::string key;
+        if (byParent) {
+            // No key contains '\0', so the parent decides first
+            key = getCollationKey(removeQuotes(getParentDirNameFromPath(paths[i])));
+            key += '\0';
+        }
+        key += getCollationKey(getNameFromPath(paths[i]));
+        entries.push_back({std::move(key), i});
+    }
+    std::sort(entries.begin(), entries.end(), [&](const SortEntry& a, const SortEntry& b) {
+        // Names that only differ in case or leading zeros keep a fixed order
+        const int order = a.key.compare(b.key);
+        return order != 0 ? order < 0 : paths[a.index] < paths[b.index];
+    });
+    std::vector<std::string> sorted;
+    sorted.reserve(paths.size());
+    for (const auto& entry : entries) {
+        sorted.push_back(std::move(paths[entry.index]));
+    }
+    paths = std::move(sorted);
+}
+
 std::string getNameWithoutPrefix(std::string Name) {
     std::regex pattern("^(\\d{1,2})_");
     std::smatch matches;
@@ -162,24 +196,13 @@ std::string getNameWithoutPrefix(std::string Name) {
 std::vector<std::string> getSubdirectories(const std::string& directoryPath) {
     std::vector<std::string> subdirectories;
 
-    DIR* dir = opendir(directoryPath.c_str());
-    if (dir != nullptr) {
-        struct dirent* entry;
-        while ((entry = readdir(dir)) != nullptr) {
-            std::string entryName = entry->d_name;
-
-            // Exclude current directory (.) and parent directory (..)
-            if (entryName != "." && entryName != "..") {
-                struct stat entryStat;
-                std::string fullPath = directoryPath + "/" + entryName;
-
-                if (stat(fullPath.c_str(), &entryStat) == 0 && S_ISDIR(entryStat.st_mode)) {
-                    subdirectories.push_back(entryName);
-                }
+    auto snapshot = getDirectorySnapshot(directoryPath);
+    if (snapshot) {
+        for (const auto& entry : snapshot->entries) {
+            if (entry.isDirectory) {
+                subdirectories.emplace_back(snapshot->name(entry));
             }
         }
-
-        closedir(dir);
     }
 
     return subdirectories;
@@ -188,28 +211,23 @@ std::vector<std::string> getSubdirectories(const std::string& directoryPath) {
 std::vector<std::string> getFilesListFromDirectory(const std::string& directoryPath) {
     std::vector<std::string> fileList;
 
-    DIR* dir = opendir(directoryPath.c_str());
-    if (dir != nullptr) {
-        dirent* entry;
-        while ((entry = readdir(dir)) != nullptr) {
-            std::string entryName = entry->d_name;
-            std::string entryPath = directoryPath;
-            if (entryPath.back() != '/')
-                entryPath += '/';
-            entryPath += entryName;
-
-            // Skip directories "." and ".."
-            if (entryName != "." && entryName != "..") {
-                if (isDirectory(entryPath)) {
-                    // Recursively retrieve files from subdirectories
-                    std::vector<std::string> subDirFiles = getFilesListFromDirectory(entryPath);
-                    fileList.insert(fileList.end(), subDirFiles.begin(), subDirFiles.end());
-                } else {
-                    fileList.push_back(entryPath);
-                }
+    auto snapshot = getDirectorySnapshot(directoryPath);
+    if (snapshot) {
+        std::string directoryPrefix = directoryPath;
+        if (directoryPrefix.back() != '/')
+            directoryPrefix += '/';
+
+        for (const auto& entry : snapshot->entries) {
+            std::string entryPath = directoryPrefix;
+            entryPath += snapshot->name(entry);
+            if (entry.isDirectory) {
+                // Recursively retrieve files from subdirectories
+                std::vector<std::string> subDirFiles = getFilesListFromDirectory(entryPath);
+                fileList.insert(fileList.end(), subDirFiles.begin(), subDirFiles.end());
+            } else {
+                fileList.push_back(std::move(entryPath));
             }
         }
-        closedir(dir);
     }
 
     return fileList;
@@ -218,116 +236,13 @@ std::vector<std::string> getFilesListFromDirectory(const std::string& directoryP
 
 // get files list for file patterns and folders list for folder patterns
 std::vector<std::string> getFilesListByWildcard(const std::string& pathPattern) {
-    std::string dirPath = "";
-    std::string wildcard = "";
-
-    std::size_t wildcardPos = pathPattern.find('*');
-    if (wildcardPos != std::string::npos) {
-        std::size_t slashPos = pathPattern.rfind('/', wildcardPos);
-
-        if (slashPos != std::string::npos) {
-            dirPath = pathPattern.substr(0, slashPos + 1);
-            wildcard = pathPattern.substr(slashPos + 1);
-        } else {
-            dirPath = "";
-            wildcard = pathPattern;
-        }
-    } else {
-        dirPath = pathPattern + "/";
-    }
-
-    //log("dirPath: " + dirPath);
-    //log("wildcard: " + wildcard);
-
-    std::vector<std::string> fileList;
-
-    bool isFolderWildcard = wildcard.back() == '/';
-    if (isFolderWildcard) {
-        wildcard.resize(wildcard.size() - 1);  // Remove the trailing slash
-    }
-
-    //log("isFolderWildcard: " + std::to_string(isFolderWildcard));
-
-    DIR* dir = opendir(dirPath.c_str());
-    if (dir != nullptr) {
-        dirent* entry;
-        while ((entry = readdir(dir)) != nullptr) {
-            std::string entryName = entry->d_name;
-            std::string entryPath = dirPath + entryName;
-
-            bool isEntryDirectory = isDirectory(entryPath);
-
-            //log("entryName: " + entryName);
-            //log("entryPath: " + entryPath);
-            //log("isFolderWildcard: " + std::to_string(isFolderWildcard));
-            //log("isEntryDirectory: " + std::to_string(isEntryDirectory));
-
-            if (isFolderWildcard && isEntryDirectory && fnmatch(wildcard.c_str(), entryName.c_str(), FNM_NOESCAPE) == 0) {
-                if (entryName != "." && entryName != "..") {
-                    fileList.push_back(entryPath+"/");
-                }
-            } else if (!isFolderWildcard && !isEntryDirectory) {
-                std::size_t wildcardPos = wildcard.find('*');
-                if (wildcardPos != std::string::npos) {
-                    std::string prefix = wildcard.substr(0, wildcardPos);
-                    if (entryName.starts_with(prefix)) {
-                        std::string suffix = wildcard.substr(wildcardPos + 1);
-                        if (entryName.size() >= suffix.size() && entryName.compare(entryName.size() - suffix.size(), suffix.size(), suffix) == 0) {
-                            fileList.push_back(entryPath);
-                        }
-                    }
-                } else if (fnmatch(wildcard.c_str(), entryName.c_str(), FNM_NOESCAPE) == 0) {
-                    fileList.push_back(entryPath);
-                }
-            }
-        }
-        closedir(dir);
-    }
-
-    //std::string fileListAsString;
-    //for (const std::string& filePath : fileList) {
-    //    fileListAsString += filePath + "\n";
-    //}
-    //log("File List:\n" + fileListAsString);
-
-    return fileList;
+    return findGlobMatches(pathPattern);
 }
 
-
-std::vector<std::string> getFilesListByWildcards(const std::string& pathPattern) {
-    std::vector<std::string> fileList;
-
-    // Check if the pattern contains multiple wildcards
-    std::size_t wildcardPos = pathPattern.find('*');
-    if (wildcardPos != std::string::npos && pathPattern.find('*', wildcardPos + 1) != std::string::npos) {
-        std::string dirPath = "";
-        std::string wildcard = "";
-
-        // Extract the directory path and the first wildcard
-        std::size_t slashPos = pathPattern.rfind('/', wildcardPos);
-        if (slashPos != std::string::npos) {
-            dirPath = pathPattern.substr(0, slashPos + 1);
-            wildcard = pathPattern.substr(slashPos + 1, wildcardPos - slashPos - 1);
-        } else {
-            dirPath = "";
-            wildcard = pathPattern.substr(0, wildcardPos);
-        }
-
-        // Get the list of directories matching the first wildcard
-        std::vector<std::string> subDirs = getFilesListByWildcard(dirPath + wildcard + "*/");
-
-        // Process each subdirectory recursively
-        for (const std::string& subDir : subDirs) {
-            std::string subPattern = subDir + removeLeadingSlash(pathPattern.substr(wildcardPos + 1));
-            std::vector<std::string> subFileList = getFilesListByWildcards(subPattern);
-            fileList.insert(fileList.end(), subFileList.begin(), subFileList.end());
-        }
-    } else {
-        // Only one wildcard present, use getFilesListByWildcard directly
-        fileList = getFilesListByWildcard(pathPattern);
-    }
-
-    return fileList;
+// Same as getFilesListByWildcard, patterns with any number of wildcard levels are walked in one pass.
+// Paths starting with one of the excluded prefixes are left out without walking them.
+std::vector<std::string> getFilesListByWildcards(const std::string& pathPattern, const GlobExclusions& exclusions = GlobExclusions()) {
+    return findGlobMatches(pathPattern, exclusions);
 }
 
 
@@ -340,185 +255,3 @@ std::string replacePlaceholder(const std::string& input, const std::string& plac
     }
     return result;
 }
-
-std::string replaceJsonSourcePlaceholder(const std::string& placeholder, const std::string& jsonPath, std::string searchString = "{json_data(") {
-    // Load JSON data from the provided file
-    json_error_t error;
-    SafeJson root = json_load_file(jsonPath.c_str(), 0, &error);
-
-    if (!root) {
-        // Handle JSON parsing error
-        // printf("JSON parsing error: %s\n", error.text);
-        return placeholder;  // Return the original placeholder if JSON parsing fails
-    }
-
-    std::string replacement = placeholder;
-    
-    std::size_t startPos = replacement.find(searchString);
-    std::size_t endPos = replacement.find(")}");
-    if (startPos != std::string::npos && endPos != std::string::npos && endPos > startPos) {
-        std::string jsonPathArgs = replacement.substr(startPos + searchString.length(), endPos - startPos - searchString.length());
-        std::vector<std::string> keys;
-        std::string key;
-        std::istringstream keyStream(jsonPathArgs);
-        while (std::getline(keyStream, key, ',')) {
-            keys.push_back(trim(key));
-        }
-
-        // Traverse the JSON structure based on the keys
-        json_t* current = root;
-        for (const auto& key : keys) {
-            if (json_is_object(current)) {
-                current = json_object_get(current, key.c_str());
-            } else if (json_is_array(current)) {
-                if (key == "[]") {
-                    size_t index = 0;
-                    while (json_array_size(current) > index) {
-                        json_t* arrayItem = json_array_get(current, index);
-                        if (json_is_object(arrayItem)) {
-                            current = arrayItem;
-                            break;
-                        }
-                        ++index;
-                    }
-                } else {
-                    size_t index = std::stoul(key);
-                    if (index < json_array_size(current)) {
-                        current = json_array_get(current, index);
-                    } else {
-                        // Handle invalid JSON array index
-                        // printf("Invalid JSON array index: %s\n", key.c_str());
-                        return placeholder;  // Return the original placeholder if JSON array index is invalid
-                    }
-                }
-            } else {
-                // Handle invalid JSON structure or key
-                // printf("Invalid JSON structure or key: %s\n", key.c_str());
-                return placeholder;  // Return the original placeholder if JSON structure or key is invalid
-            }
-        }
-
-        if (json_is_string(current)) {
-            std::string url = json_string_value(current);
-            // Replace the entire placeholder with the URL
-            replacement.replace(startPos, endPos - startPos + searchString.length() + 2, url);
-        }
-    }
-
-    return replacement;
-}
-
-
-
-std::vector<std::vector<std::string>> getModifyCommands(const std::vector<std::vector<std::string>>& commands, const std::string& file, bool toggle = false, bool on = true, bool usingJsonSource = false) {
-    std::vector<std::vector<std::string>> modifiedCommands;
-    std::string jsonPath, replacement;
-    
-    bool addCommands = false;
-    for (const auto& cmd : commands) {
-        if (cmd.size() > 1) {
-            if (toggle) {
-                if (cmd[0] == "source_on") {
-                    addCommands = true;
-                    if (!on) {
-                        addCommands = !addCommands;
-                    }
-                } else if (cmd[0] == "source_off") {
-                    addCommands = false;
-                    if (!on) {
-                        addCommands = !addCommands;
-                    }
-                }
-            }
-            if ((usingJsonSource) && (cmd[0] == "json_source" || cmd[0] == "json_mark_cur_kip" || cmd[0] == "json_mark_cur_ini")) {
-                jsonPath = preprocessPath(cmd[1]);
-            } 
-        }
-        if (!toggle or addCommands) {
-            std::vector<std::string> modifiedCmd = cmd;
-            for (auto& arg : modifiedCmd) {
-                if (!toggle && (arg.find("{source}") != std::string::npos)) {
-                    arg = replacePlaceholder(arg, "{source}", file);
-                } else if (on && (arg.find("{source_on}") != std::string::npos)) {
-                    arg = replacePlaceholder(arg, "{source_on}", file);
-                } else if (!on && (arg.find("{source_off}") != std::string::npos)) {
-                    arg = replacePlaceholder(arg, "{source_off}", file);
-                } else if (arg.find("{name}") != std::string::npos) {
-                    arg = replacePlaceholder(arg, "{name}", getNameFromPath(file));
-                } else if (arg.find("{parent_name}") != std::string::npos) {
-                    arg = replacePlaceholder(arg, "{parent_name}", getParentDirNameFromPath(file));
-                //} else if (arg.find("{json_source(") != std::string::npos) {
-                //    size_t startPos = arg.find("{json_source(");
-                //    size_t endPos = arg.find(")}");
-                //    if (endPos != std::string::npos && endPos > startPos) {
-                //        std::string placeholder = "*";
-                //        std::string replacement = arg.substr(startPos, endPos - startPos + 2);
-                //        size_t placeholderPos = replacement.find(placeholder);
-                //        if (placeholderPos != std::string::npos) {
-                //            replacement.replace(placeholderPos, placeholder.length(), file);
-                //            //arg.replace(startPos, endPos - startPos + 2, replacement);
-                //        }
-                //        
-                //        replacement = replaceJsonSourcePlaceholder(replacement, jsonPath, true);
-                //        //log2("replacement: "+replacement);
-                //        //log2("pre-arg: "+arg);
-                //        arg.replace(startPos, endPos - startPos + 2, replacement);
-                //    }
-                } else if (usingJsonSource && (arg.find("{json_source(") != std::string::npos)) {
-                    std::string countStr = file;
-                    
-                    // log(std::string("count: ")+countStr);
-                    // log(std::string("pre arg: ") + arg);
-                    arg = replacePlaceholder(arg, "*", file);
-                    // log(std::string("post arg: ") + arg);
-
-                    
-                    size_t startPos = arg.find("{json_source(");
-                    size_t endPos = arg.find(")}");
-                    if (endPos != std::string::npos && endPos > startPos) {
-                        replacement = replaceJsonSourcePlaceholder(arg.substr(startPos, endPos - startPos + 2), jsonPath, "{json_source(");
-                        //log2("replacement: "+replacement);
-                        //log2("pre-arg: "+arg);
-                        arg.replace(startPos, endPos - startPos + 2, replacement);
-                        //log2("post-arg: "+arg);
-                    }
-                } else if (usingJsonSource && (arg.find("{json_mark_cur_kip(") != std::string::npos)) {
-                    std::string countStr = file;
-                    
-                    // log(std::string("count: ")+countStr);
-                    // log(std::string("pre arg: ") + arg);
-                    arg = replacePlaceholder(arg, "*", file);
-                    // log(std::string("post arg: ") + arg);
-
-                    
-                    size_t startPos = arg.find("{json_mark_cur_kip(");
-                    size_t endPos = arg.find(")}");
-                    if (endPos != std::string::npos && endPos > startPos) {
-                        replacement = replaceJsonSourcePlaceholder(arg.substr(startPos, endPos - startPos + 2), jsonPath, "{json_mark_cur_kip(");
-                        arg.replace(startPos, endPos - startPos + 2, replacement);
-                    }
-                } else if (usingJsonSource && (arg.find("{json_mark_cur_ini(") != std::string::npos)) {
-                    std::string countStr = file;
-                    
-                    // log(std::string("count: ")+countStr);
-                    // log(std::string("pre arg: ") + arg);
-                    arg = replacePlaceholder(arg, "*", file);
-                    // log(std::string("post arg: ") + arg);
-
-                    
-                    size_t startPos = arg.find("{json_mark_cur_ini(");
-                    size_t endPos = arg.find(")}");
-                    if (endPos != std::string::npos && endPos > startPos) {
-                        replacement = replaceJsonSourcePlaceholder(arg.substr(startPos, endPos - startPos + 2), jsonPath, "{json_mark_cur_ini(");
-                        //log2("replacement: "+replacement);
-                        //log2("pre-arg: "+arg);
-                        arg.replace(startPos, endPos - startPos + 2, replacement);
-                        //log2("post-arg: "+arg);
-                    }
-                }
-            }
-            modifiedCommands.emplace_back(modifiedCmd);
-        }
-    }
-    return modifiedCommands;
-}
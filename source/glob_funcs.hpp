@@ -0,0 +1,594 @@
+#pragma once
+#include <sys/stat.h>
+#include <algorithm>
+#include <bitset>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+#include <dir_funcs.hpp>
+
+// Path patterns. Within one path level "*" matches any run of characters, "?" any one character,
+// "[abc]", "[a-z]" and "[!a-z]" one character of a class and "{a,b}" either alternative.
+// A level that is just "**" matches any number of levels. A pattern ending with '/' matches directories,
+// otherwise files. A name always matches itself as well, so names that contain these characters still work.
+//
+// A pattern is compiled once into a program per level and then matched in a single walk of the tree.
+// Levels without wildcards are looked up directly instead of listing their parent.
+struct GlobToken {
+    enum Kind : uint8_t {
+        Literal, // A run of characters
+        Any,     // ?
+        Class,   // [...]
+        Star     // *
+    };
+    Kind kind;
+    uint32_t index; // Offset into the literal text or index of the class
+    uint32_t length;
+};
+
+struct GlobAlternative {
+    enum Kind : uint8_t {
+        Exact,   // No wildcards
+        All,     // *
+        Affixes, // prefix*suffix
+        Program  // Anything else, matched token by token
+    };
+    Kind kind = Exact;
+    std::string text;   // The alternative as written; the prefix for Affixes, the literal runs for Program
+    std::string suffix; // Affixes only
+    std::vector<GlobToken> tokens;
+    std::vector<std::bitset<256>> classes;
+};
+
+struct GlobLevel {
+    bool recursive = false; // **
+    bool literal = true;    // Every alternative is Exact
+    std::vector<GlobAlternative> alternatives;
+};
+
+struct GlobPattern {
+    std::string root; // Leading levels without wildcards, ending with '/' unless empty
+    std::vector<GlobLevel> levels;
+    bool directoriesOnly = false;
+    bool mayRepeat = false; // More than one ** can reach a path in several ways
+};
+
+// Expands "{a,b}" groups, nested ones included. A '{' without a matching '}' or a ',' stays as it is.
+void expandGlobBraces(const std::string& text, std::vector<std::string>& expansions, size_t from = 0) {
+    // Enough for any sensible pattern, a pattern with more alternatives is taken as written
+    constexpr size_t maxExpansions = 256;
+    for (size_t open = text.find('{', from); open != std::string::npos; open = text.find('{', open + 1)) {
+        std::vector<size_t> commas;
+        size_t close = open + 1;
+        for (int depth = 0; close < text.size(); ++close) {
+            if (text[close] == '{') {
+                ++depth;
+            } else if (text[close] == '}' && depth-- == 0) {
+                break;
+            } else if (text[close] == ',' && depth == 0) {
+                commas.push_back(close);
+            }
+        }
+        if (close == text.size() || commas.empty()) {
+            continue;
+        }
+        commas.push_back(close);
+        size_t start = open + 1;
+        for (size_t comma : commas) {
+            if (expansions.size() >= maxExpansions) {
+                return;
+            }
+            const std::string expanded = text.substr(0, open) + text.substr(start, comma - start) + text.substr(close + 1);
+            expandGlobBraces(expanded, expansions, open);
+            start = comma + 1;
+        }
+        return;
+    }
+    expansions.push_back(text);
+}
+
+bool hasGlobCharacters(std::string_view text) {
+    return text.find_first_of("*?[{") != std::string_view::npos;
+}
+
+// True if path is a pattern rather than a plain path. Brackets alone don't count, they are common in names.
+bool isGlobPattern(const std::string& path) {
+    if (path.find_first_of("*?") != std::string::npos) {
+        return true;
+    }
+    std::vector<std::string> expansions;
+    expandGlobBraces(path, expansions);
+    return expansions.size() > 1;
+}
+
+GlobAlternative compileGlobAlternative(const std::string& text) {
+    GlobAlternative alternative;
+    alternative.text = text;
+    if (text.find_first_of("*?[") == std::string::npos) {
+        return alternative;
+    }
+    if (text == "*") {
+        alternative.kind = GlobAlternative::All;
+        return alternative;
+    }
+    const size_t star = text.find('*');
+    if (text.find_first_of("?[") == std::string::npos && text.find('*', star + 1) == std::string::npos) {
+        alternative.kind = GlobAlternative::Affixes;
+        alternative.text = text.substr(0, star);
+        alternative.suffix = text.substr(star + 1);
+        return alternative;
+    }
+
+    alternative.kind = GlobAlternative::Program;
+    std::string literals;
+    for (size_t i = 0; i < text.size(); ++i) {
+        const char c = text[i];
+        if (c == '*') {
+            if (alternative.tokens.empty() || alternative.tokens.back().kind != GlobToken::Star) {
+                alternative.tokens.push_back({GlobToken::Star, 0, 0});
+            }
+            continue;
+        }
+        if (c == '?') {
+            alternative.tokens.push_back({GlobToken::Any, 0, 1});
+            continue;
+        }
+        if (c == '[') {
+            // A class needs its closing ']', a ']' right after the opening (and '!' or '^') is part of it
+            size_t end = i + 1;
+            const bool negate = end < text.size() && (text[end] == '!' || text[end] == '^');
+            if (negate) {
+                ++end;
+            }
+            const size_t first = end;
+            if (end < text.size() && text[end] == ']') {
+                ++end;
+            }
+            end = text.find(']', end);
+            if (end != std::string::npos) {
+                std::bitset<256> members;
+                for (size_t j = first; j < end; ++j) {
+                    const unsigned char from = text[j];
+                    if (j + 2 < end && text[j + 1] == '-') {
+                        const unsigned char to = text[j + 2];
+                        for (unsigned int member = from; member <= to; ++member) {
+                            members.set(member);
+                        }
+                        j += 2;
+                    } else {
+                        members.set(from);
+                    }
+                }
+                if (negate) {
+                    members.flip();
+                }
+                alternative.tokens.push_back({GlobToken::Class, static_cast<uint32_t>(alternative.classes.size()), 1});
+                alternative.classes.push_back(members);
+                i = end;
+                continue;
+            }
+        }
+        if (!alternative.tokens.empty() && alternative.tokens.back().kind == GlobToken::Literal) {
+            ++alternative.tokens.back().length;
+        } else {
+            alternative.tokens.push_back({GlobToken::Literal, static_cast<uint32_t>(literals.size()), 1});
+        }
+        literals += c;
+    }
+    alternative.text = std::move(literals);
+    return alternative;
+}
+
+GlobPattern compileGlob(const std::string& pattern) {
+    GlobPattern glob;
+    std::string_view rest = pattern;
+    if (!rest.empty() && rest.back() == '/') {
+        glob.directoriesOnly = true;
+        rest.remove_suffix(1);
+    }
+
+    // Split into levels at the slashes outside of braces
+    std::vector<std::string_view> levels;
+    size_t start = 0;
+    for (size_t i = 0, depth = 0; i <= rest.size(); ++i) {
+        if (i == rest.size() || (rest[i] == '/' && depth == 0)) {
+            levels.push_back(rest.substr(start, i - start));
+            start = i + 1;
+        } else if (rest[i] == '{') {
+            ++depth;
+        } else if (rest[i] == '}' && depth > 0) {
+            --depth;
+        }
+    }
+
+    // The levels before the first one with wildcards make up the root, the last level is always matched
+    size_t first = 0;
+    while (first + 1 < levels.size() && !hasGlobCharacters(levels[first])) {
+        glob.root.append(levels[first]);
+        glob.root += '/';
+        ++first;
+    }
+
+    size_t recursiveLevels = 0;
+    for (size_t i = first; i < levels.size(); ++i) {
+        GlobLevel level;
+        if (levels[i] == "**") {
+            if (!glob.levels.empty() && glob.levels.back().recursive) {
+                continue;
+            }
+            level.recursive = true;
+            level.literal = false;
+            ++recursiveLevels;
+        } else {
+            std::vector<std::string> expansions;
+            expandGlobBraces(std::string(levels[i]), expansions);
+            if (expansions.size() > 1) {
+                // The level as written is kept as a name of its own
+                expansions.push_back(std::string(levels[i]));
+            }
+            for (const auto& expansion : expansions) {
+                GlobAlternative alternative = compileGlobAlternative(expansion);
+                if (alternative.kind != GlobAlternative::Exact) {
+                    level.literal = false;
+                    // The name as written matches as well
+                    GlobAlternative name;
+                    name.text = expansion;
+                    level.alternatives.push_back(std::move(name));
+                }
+                level.alternatives.push_back(std::move(alternative));
+            }
+        }
+        glob.levels.push_back(std::move(level));
+    }
+    glob.mayRepeat = recursiveLevels > 1;
+    return glob;
+}
+
+bool matchGlobProgram(const GlobAlternative& alternative, std::string_view name) {
+    const std::vector<GlobToken>& tokens = alternative.tokens;
+    size_t token = 0, position = 0;
+    size_t starToken = std::string::npos, starPosition = 0;
+    while (position < name.size()) {
+        if (token < tokens.size()) {
+            const GlobToken& current = tokens[token];
+            if (current.kind == GlobToken::Star) {
+                starToken = token++;
+                starPosition = position;
+                continue;
+            }
+            bool matched;
+            if (current.kind == GlobToken::Literal) {
+                matched = name.compare(position, current.length, std::string_view(alternative.text).substr(current.index, current.length)) == 0;
+            } else if (current.kind == GlobToken::Class) {
+                matched = alternative.classes[current.index].test(static_cast<unsigned char>(name[position]));
+            } else {
+                matched = true;
+            }
+            if (matched && position + current.length <= name.size()) {
+                position += current.length;
+                ++token;
+                continue;
+            }
+        }
+        if (starToken == std::string::npos) {
+            return false;
+        }
+        // Let the last star take one more character and try again from there
+        token = starToken + 1;
+        position = ++starPosition;
+    }
+    while (token < tokens.size() && tokens[token].kind == GlobToken::Star) {
+        ++token;
+    }
+    return token == tokens.size();
+}
+
+bool matchGlobLevel(const GlobLevel& level, std::string_view name) {
+    for (const auto& alternative : level.alternatives) {
+        switch (alternative.kind) {
+            case GlobAlternative::Exact:
+                if (name == alternative.text) {
+                    return true;
+                }
+                break;
+            case GlobAlternative::All:
+                return true;
+            case GlobAlternative::Affixes:
+                if (name.size() >= alternative.text.size() + alternative.suffix.size() && name.starts_with(alternative.text) && name.ends_with(alternative.suffix)) {
+                    return true;
+                }
+                break;
+            case GlobAlternative::Program:
+                if (matchGlobProgram(alternative, name)) {
+                    return true;
+                }
+                break;
+        }
+    }
+    return false;
+}
+
+// Paths starting with any of the prefixes are left out of a walk, their directories aren't entered at all
+struct GlobExclusions {
+    std::vector<std::string> prefixes; // Sorted, none starts with another
+
+    GlobExclusions(std::vector<std::string> list = {}) {
+        std::sort(list.begin(), list.end());
+        for (auto& prefix : list) {
+            if (prefixes.empty() || !std::string_view(prefix).starts_with(prefixes.back())) {
+                prefixes.push_back(std::move(prefix));
+            }
+        }
+    }
+
+    bool excludes(std::string_view path) const {
+        // A prefix of path sorts before it, and nothing sorts in between that doesn't share the prefix
+        auto it = std::upper_bound(prefixes.begin(), prefixes.end(), path, [](std::string_view value, const std::string& prefix) {
+            return value < prefix;
+        });
+        return it != prefixes.begin() && path.starts_with(*std::prev(it));
+    }
+};
+
+// State of one walk. onMatch returns false to end the walk early.
+template <typename OnMatch>
+struct GlobWalk {
+    const GlobPattern& glob;
+    const GlobExclusions& exclusions;
+    OnMatch& onMatch;
+    std::unordered_set<std::string> seen;
+    bool parallel = true; // Walks run for a fan-out don't fan out again
+
+    bool match(const std::string& path) {
+        if (exclusions.excludes(path) || (glob.mayRepeat && !seen.insert(path).second)) {
+            return true;
+        }
+        return onMatch(path);
+    }
+
+    bool enter(const std::string& path) const {
+        return !exclusions.excludes(path);
+    }
+};
+
+template <typename OnMatch>
+bool walkGlob(GlobWalk<OnMatch>& walk, const std::string& directoryPath, size_t levelIndex);
+
+// A directory with many subdirectories to walk (contents/* with hundreds of title IDs) has them walked by a
+// few threads. Most of the time goes into waiting on the SD card, so the waits overlap. The matches are
+// passed on in listing order, the same order a walk on one thread gives. Workers stay at most a window of
+// subdirectories ahead of the one being passed on, which bounds the matches held at any time.
+constexpr size_t globWorkerCount = 2;
+constexpr size_t globFanOutMinimum = 16;
+constexpr size_t globFanOutWindow = 32;
+
+struct GlobTask {
+    std::string path;
+    bool match = false;   // path itself is a match
+    bool descend = false; // path is walked for the next levels
+};
+
+struct GlobFanOut {
+    const GlobPattern* glob;
+    const GlobExclusions* exclusions;
+    const std::vector<GlobTask>* tasks;
+    size_t levelIndex; // Level the descending tasks are walked for
+    std::vector<std::vector<std::string>> results;
+    std::vector<bool> done;
+    size_t next = 0;     // First task not taken yet
+    size_t consumed = 0; // First task whose matches weren't passed on yet
+    bool stopped = false;
+    size_t waitingFor = SIZE_MAX; // Task the calling thread waits for
+    size_t idleWorkers = 0;       // Workers waiting for the window to move
+    Mutex mutex;
+    CondVar condvar;
+};
+
+struct GlobCollector {
+    std::vector<std::string>* matches;
+
+    bool operator()(const std::string& path) {
+        matches->push_back(path);
+        return true;
+    }
+};
+
+void runGlobTask(GlobFanOut* fanOut, size_t index) {
+    const GlobTask& task = (*fanOut->tasks)[index];
+    std::vector<std::string> matches;
+    if (task.descend) {
+        GlobCollector collector{&matches};
+        GlobWalk<GlobCollector> walk{*fanOut->glob, *fanOut->exclusions, collector, {}, false};
+        walkGlob(walk, task.path, fanOut->levelIndex);
+    }
+    mutexLock(&fanOut->mutex);
+    fanOut->results[index] = std::move(matches);
+    fanOut->done[index] = true;
+    if (fanOut->waitingFor == index) {
+        condvarWakeAll(&fanOut->condvar);
+    }
+    mutexUnlock(&fanOut->mutex);
+}
+
+void globWorkerThread(void* arg) {
+    GlobFanOut* fanOut = static_cast<GlobFanOut*>(arg);
+    const size_t taskCount = fanOut->tasks->size();
+    while (true) {
+        mutexLock(&fanOut->mutex);
+        while (!fanOut->stopped && fanOut->next < taskCount && fanOut->next >= fanOut->consumed + globFanOutWindow) {
+            ++fanOut->idleWorkers;
+            condvarWait(&fanOut->condvar, &fanOut->mutex);
+            --fanOut->idleWorkers;
+        }
+        if (fanOut->stopped || fanOut->next >= taskCount) {
+            mutexUnlock(&fanOut->mutex);
+            return;
+        }
+        const size_t index = fanOut->next++;
+        mutexUnlock(&fanOut->mutex);
+        runGlobTask(fanOut, index);
+    }
+}
+
+// Runs the tasks on the workers and the calling thread, passing the matches on in task order.
+// Returns false once the walk was ended.
+template <typename OnMatch>
+bool runGlobFanOut(GlobWalk<OnMatch>& walk, const std::vector<GlobTask>& tasks, size_t levelIndex) {
+    GlobFanOut fanOut;
+    fanOut.glob = &walk.glob;
+    fanOut.exclusions = &walk.exclusions;
+    fanOut.tasks = &tasks;
+    fanOut.levelIndex = levelIndex;
+    fanOut.results.resize(tasks.size());
+    fanOut.done.resize(tasks.size(), false);
+    mutexInit(&fanOut.mutex);
+    condvarInit(&fanOut.condvar);
+
+    Thread workers[globWorkerCount];
+    size_t workerCount = 0;
+    for (; workerCount < globWorkerCount; ++workerCount) {
+        if (R_FAILED(threadCreate(&workers[workerCount], globWorkerThread, &fanOut, nullptr, 0x10000, 0x2C, -2))) {
+            break;
+        }
+        if (R_FAILED(threadStart(&workers[workerCount]))) {
+            threadClose(&workers[workerCount]);
+            break;
+        }
+    }
+
+    bool result = true;
+    for (size_t index = 0; index < tasks.size() && result; ++index) {
+        mutexLock(&fanOut.mutex);
+        if (fanOut.next == index) {
+            // Not taken by a worker yet, walk it here instead of waiting
+            ++fanOut.next;
+            mutexUnlock(&fanOut.mutex);
+            runGlobTask(&fanOut, index);
+            mutexLock(&fanOut.mutex);
+        }
+        fanOut.waitingFor = index;
+        while (!fanOut.done[index]) {
+            condvarWait(&fanOut.condvar, &fanOut.mutex);
+        }
+        fanOut.waitingFor = SIZE_MAX;
+        std::vector<std::string> matches = std::move(fanOut.results[index]);
+        fanOut.consumed = index + 1;
+        if (fanOut.idleWorkers > 0) {
+            condvarWakeAll(&fanOut.condvar);
+        }
+        mutexUnlock(&fanOut.mutex);
+
+        if (tasks[index].match && !walk.match(tasks[index].path)) {
+            result = false;
+        }
+        for (size_t i = 0; i < matches.size() && result; ++i) {
+            result = walk.match(matches[i]);
+        }
+    }
+
+    mutexLock(&fanOut.mutex);
+    fanOut.stopped = true;
+    condvarWakeAll(&fanOut.condvar);
+    mutexUnlock(&fanOut.mutex);
+    for (size_t i = 0; i < workerCount; ++i) {
+        threadWaitForExit(&workers[i]);
+        threadClose(&workers[i]);
+    }
+    return result;
+}
+
+// Walks directoryPath (ending with '/') for the levels from levelIndex on. Returns false once the walk was ended.
+template <typename OnMatch>
+bool walkGlob(GlobWalk<OnMatch>& walk, const std::string& directoryPath, size_t levelIndex) {
+    const GlobPattern& glob = walk.glob;
+    const GlobLevel& level = glob.levels[levelIndex];
+    const bool isLast = levelIndex + 1 == glob.levels.size();
+
+    if (level.literal) {
+        // Nothing to list, the names are known
+        for (const auto& alternative : level.alternatives) {
+            const std::string path = directoryPath + alternative.text;
+            struct stat pathInfo;
+            if (alternative.text.empty() || stat(path.c_str(), &pathInfo) != 0) {
+                continue;
+            }
+            const bool isDirectory = S_ISDIR(pathInfo.st_mode);
+            if (!isLast) {
+                if (isDirectory && walk.enter(path + "/") && !walkGlob(walk, path + "/", levelIndex + 1)) {
+                    return false;
+                }
+            } else if (isDirectory == glob.directoriesOnly && !walk.match(isDirectory ? path + "/" : path)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    if (level.recursive && !isLast) {
+        // ** standing for no level at all
+        if (!walkGlob(walk, directoryPath, levelIndex + 1)) {
+            return false;
+        }
+    }
+    auto snapshot = getDirectorySnapshot(directoryPath);
+    if (!snapshot) {
+        return true;
+    }
+    std::vector<GlobTask> tasks;
+    size_t descending = 0;
+    for (const auto& entry : snapshot->entries) {
+        const std::string_view name = snapshot->name(entry);
+        if (!level.recursive && (!matchGlobLevel(level, name) || !(isLast ? entry.isDirectory == glob.directoriesOnly : entry.isDirectory))) {
+            continue;
+        }
+        GlobTask task;
+        task.path = directoryPath;
+        task.path += name;
+        if (entry.isDirectory) {
+            task.path += '/';
+        }
+        task.match = isLast && entry.isDirectory == glob.directoriesOnly;
+        // The next level, or for ** this level once more
+        task.descend = entry.isDirectory && (level.recursive || !isLast) && walk.enter(task.path);
+        if (task.match || task.descend) {
+            descending += task.descend;
+            tasks.push_back(std::move(task));
+        }
+    }
+    if (walk.parallel && descending >= globFanOutMinimum) {
+        return runGlobFanOut(walk, tasks, level.recursive ? levelIndex : levelIndex + 1);
+    }
+    for (const auto& task : tasks) {
+        if (task.match && !walk.match(task.path)) {
+            return false;
+        }
+        if (task.descend && !walkGlob(walk, task.path, level.recursive ? levelIndex : levelIndex + 1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Passes the files matching pathPattern, or directories with a trailing '/' if pathPattern ends with one, to
+// onMatch as they are found, in listing order. onMatch returns false to stop. Directories are listed one at a
+// time as the walk gets to them, so work on the first matches can start before the rest are known.
+template <typename OnMatch>
+void forEachGlobMatch(const std::string& pathPattern, OnMatch onMatch, const GlobExclusions& exclusions = GlobExclusions()) {
+    const GlobPattern glob = compileGlob(pathPattern);
+    if (glob.levels.empty() || exclusions.excludes(glob.root)) {
+        return;
+    }
+    GlobWalk<OnMatch> walk{glob, exclusions, onMatch, {}};
+    walkGlob(walk, glob.root, 0);
+}
+
+std::vector<std::string> findGlobMatches(const std::string& pathPattern, const GlobExclusions& exclusions = GlobExclusions()) {
+    std::vector<std::string> matches;
+    forEachGlobMatch(pathPattern, [&](const std::string& path) {
+        matches.push_back(path);
+        return true;
+    }, exclusions);
+    return matches;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// Non-cryptographic hashing for change detection
+const uint64_t fnv1aOffsetBasis = 0xcbf29ce484222325ULL;
+const uint64_t fnv1aPrime = 0x100000001b3ULL;
+
+uint64_t fnv1aHash(const void* data, size_t size, uint64_t hash = fnv1aOffsetBasis) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= fnv1aPrime;
+    }
+    return hash;
+}
+
+uint64_t fnv1aHash(const std::string& str, uint64_t hash = fnv1aOffsetBasis) {
+    return fnv1aHash(str.data(), str.size(), hash);
+}
+
+std::string hashToHex(uint64_t hash) {
+    char hex[17];
+    std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+    return hex;
+}
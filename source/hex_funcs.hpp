@@ -203,18 +203,11 @@ std::string readHexDataAtOffsetF(FILE* const file, const size_t offset, const si
     return result;
 }
 
-bool hexEditByOffset(const std::string& filePath, const size_t offset, const std::string& hexData) {
-    // Open the file for reading and writing in binary mode
-    FILE* file = fopen(filePath.c_str(), "rb+");
-    if (!file) {
-        log("Failed to open the file.");
-        return false;
-    }
-
+// Writes hexData at offset of an already opened file, bytes that are already in place are left alone
+bool hexEditAtOffsetF(FILE* const file, const size_t offset, const std::string& hexData) {
     // Move the file pointer to the specified offset
     if (fseek(file, offset, SEEK_SET) != 0) {
         log("Failed to move the file pointer.");
-        fclose(file);
         return false;
     }
 
@@ -233,26 +226,39 @@ bool hexEditByOffset(const std::string& filePath, const size_t offset, const std
     std::vector<unsigned char> existingData(bytesToReplace);
     if (fread(existingData.data(), sizeof(unsigned char), bytesToReplace, file) != bytesToReplace) {
         log("Failed to read existing data from the file.");
-        fclose(file);
         return false;
     }
 
+    // Nothing to do if the bytes are already in place
+    if (existingData == binaryData) {
+        return true;
+    }
+
     // Move the file pointer back to the offset
     if (fseek(file, offset, SEEK_SET) != 0) {
         log("Failed to move the file pointer.");
-        fclose(file);
         return false;
     }
 
     // Write the replacement binary data to the file
     if (fwrite(binaryData.data(), sizeof(unsigned char), bytesToReplace, file) != bytesToReplace) {
         log("Failed to write data to the file.");
-        fclose(file);
+        return false;
+    }
+    return true;
+}
+
+bool hexEditByOffset(const std::string& filePath, const size_t offset, const std::string& hexData) {
+    // Open the file for reading and writing in binary mode
+    FILE* file = fopen(filePath.c_str(), "rb+");
+    if (!file) {
+        log("Failed to open the file.");
         return false;
     }
 
+    const bool result = hexEditAtOffsetF(file, offset, hexData);
     fclose(file);
-    return true;
+    return result;
 }
 
 // Is used when mutiple write iterrations are required to reduce the number of file open/close requests
@@ -266,55 +272,63 @@ bool hexEditByOffsetF(const std::string& filePath, const std::map <std::string,s
     }
 
     for(const auto& ov : data) {
-        
-        // Convert the offset string to std::streampos
-        std::streampos offset = std::stoll(ov.first);
-        std::string hexData = ov.second;
-
-        // Move the file pointer to the specified offset
-        if (fseek(file, offset, SEEK_SET) != 0) {
-            log("Failed to move the file pointer.");
+        // Convert the offset string to an offset
+        if (!hexEditAtOffsetF(file, std::stoll(ov.first), ov.second)) {
             fclose(file);
             return false;
         }
+    }
 
-        // Convert the hex data string to binary data
-        std::vector<unsigned char> binaryData;
-        for (std::size_t i = 0; i < hexData.length(); i += 2) {
-            std::string byteString = hexData.substr(i, 2);
-            unsigned char byte = static_cast<unsigned char>(std::stoi(byteString, nullptr, 16));
-            binaryData.push_back(byte);
-        }
+    fclose(file);
+    return true;
+    //log("Hex editing completed.");
+}
 
-        // Calculate the number of bytes to be replaced
-        std::size_t bytesToReplace = binaryData.size();
+struct HexEdit {
+    size_t offset;      // from the start of the file, or from "CUST" if fromCust
+    std::string hexData;
+    bool fromCust;
+};
 
-        // Read the existing data from the file
-        std::vector<unsigned char> existingData(bytesToReplace);
-        if (fread(existingData.data(), sizeof(unsigned char), bytesToReplace, file) != bytesToReplace) {
-            log("Failed to read existing data from the file.");
-            fclose(file);
-            return false;
-        }
+// Applies the edits in order with a single open of the file, one result per edit.
+// With stopOnError the edits after the first failure aren't attempted.
+std::vector<bool> hexEditBatch(const std::string& filePath, const std::vector<HexEdit>& edits, bool stopOnError) {
+    std::vector<bool> results(edits.size(), false);
+    FILE* file = fopen(filePath.c_str(), "rb+");
+    if (!file) {
+        log("Failed to open the file.");
+        return results;
+    }
 
-        // Move the file pointer back to the offset
-        if (fseek(file, offset, SEEK_SET) != 0) {
-            log("Failed to move the file pointer.");
-            fclose(file);
-            return false;
+    long custOffset = -1;
+    for (size_t i = 0; i < edits.size(); ++i) {
+        size_t offset = edits[i].offset;
+        if (edits[i].fromCust) {
+            if (custOffset < 0) {
+                fseek(file, 0, SEEK_SET);
+                custOffset = findCustOffset(file);
+            }
+            if (custOffset < 0) {
+                if (stopOnError) {
+                    break;
+                }
+                continue;
+            }
+            offset += custOffset; // count from "C" letter
         }
 
-        // Write the replacement binary data to the file
-        if (fwrite(binaryData.data(), sizeof(unsigned char), bytesToReplace, file) != bytesToReplace) {
-            log("Failed to write data to the file.");
-            fclose(file);
-            return false;
+        results[i] = hexEditAtOffsetF(file, offset, edits[i].hexData);
+        if (!results[i] && stopOnError) {
+            break;
+        }
+        // An edit before the end of the marker may have moved it
+        if (custOffset >= 0 && offset < static_cast<size_t>(custOffset) + 4) {
+            custOffset = -1;
         }
     }
 
     fclose(file);
-    return true;
-    //log("Hex editing completed.");
+    return results;
 }
 
 bool hexEditFindReplace(const std::string& filePath, const std::string& hexDataToReplace, const std::string& hexDataReplacement, const std::string& occurrence = "0") {
@@ -358,7 +372,7 @@ bool hexEditCustOffset(const std::string& filePath, const size_t offsetFromCust,
     const std::vector<size_t> custOffsets = findHexDataOffsets(filePath, CUST);
     if (!custOffsets.empty()) {
         const size_t offset = offsetFromCust + custOffsets[0]; // count from "C" letter
-        hexEditByOffset(filePath, offset, hexDataReplacement);
+        return hexEditByOffset(filePath, offset, hexDataReplacement);
     }
     else {
         return false;
@@ -326,49 +326,70 @@ std::vector<std::pair<std::string, std::vector<std::vector<std::string>>>> loadO
     return options;
 }
 
-void cleanIniFormatting(const std::string& filePath) {
-    FILE* inputFile = fopen(filePath.c_str(), "r");
-    if (!inputFile) {
-        // Failed to open the input file
-        // Handle the error accordingly
-        return;
+// INI files are edited as lines, so several edits can share one read and one write
+bool readIniLines(const std::string& filePath, std::vector<std::string>& lines) {
+    lines.clear();
+    std::ifstream file(filePath);
+    if (!file.is_open()) {
+        return false;
     }
+    std::string line;
+    while (std::getline(file, line)) {
+        lines.push_back(std::move(line));
+    }
+    return true;
+}
 
+bool writeIniLines(const std::string& filePath, const std::vector<std::string>& lines) {
     std::string tempPath = filePath + ".tmp";
-    FILE* outputFile = fopen(tempPath.c_str(), "w");
-    if (!outputFile) {
-        // Failed to create the output file
-        // Handle the error accordingly
-        fclose(inputFile);
-        return;
+    FILE* tempFile = fopen(tempPath.c_str(), "w");
+    if (!tempFile) {
+        log("Failed to create temporary file.");
+        return false;
     }
+    for (const auto& line : lines) {
+        fputs(line.c_str(), tempFile);
+        fputc('\n', tempFile);
+    }
+    fclose(tempFile);
+
+    // Remove the original file and rename the temp file
+    remove(filePath.c_str());
+    rename(tempPath.c_str(), filePath.c_str());
+    return true;
+}
 
+void cleanIniLines(std::vector<std::string>& lines) {
+    std::vector<std::string> cleanedLines;
+    cleanedLines.reserve(lines.size());
     bool isNewSection = false;
 
-    char line[4096];
-    while (fgets(line, sizeof(line), inputFile)) {
-        std::string trimmedLine = trim(std::string(line));
+    for (const auto& line : lines) {
+        std::string trimmedLine = trim(line);
 
         if (!trimmedLine.empty()) {
             if (trimmedLine[0] == '[' && trimmedLine[trimmedLine.length() - 1] == ']') {
                 if (isNewSection) {
-                    fprintf(outputFile, "\n");
+                    cleanedLines.emplace_back();
                 }
                 isNewSection = true;
             }
 
-            fprintf(outputFile, "%s\n", trimmedLine.c_str());
+            cleanedLines.push_back(std::move(trimmedLine));
         }
     }
-
-    fclose(inputFile);
-    fclose(outputFile);
-
-    // Remove the original file and rename the temp file
-    remove(filePath.c_str());
-    rename(tempPath.c_str(), filePath.c_str());
+    lines = std::move(cleanedLines);
 }
 
+void cleanIniFormatting(const std::string& filePath) {
+    std::vector<std::string> lines;
+    if (!readIniLines(filePath, lines)) {
+        // Failed to open the input file
+        return;
+    }
+    cleanIniLines(lines);
+    writeIniLines(filePath, lines);
+}
 
 /*
 1. Get a data vector: data<section<keys<values>>> 
@@ -403,128 +424,111 @@ Close file
 //     }
 // }
 
-bool setIniFile(const std::string& fileToEdit, const std::string& desiredSection, const std::string& desiredKey, const std::string& desiredValue, const std::string& desiredNewKey) {
-    FILE* configFile = fopen(fileToEdit.c_str(), "r");
-    if (!configFile) {
+// Sets desiredKey to desiredValue (or renames it to desiredNewKey) in desiredSection.
+// exists tells whether the file was there; a missing one is created with just the key.
+void setIniLines(std::vector<std::string>& lines, bool& exists, const std::string& desiredSection, const std::string& desiredKey, const std::string& desiredValue, const std::string& desiredNewKey) {
+    if (!exists) {
         // The INI file doesn't exist, create a new file and add the section and key-value pair
-        configFile = fopen(fileToEdit.c_str(), "w");
-        if (!configFile) {
-            log("Failed to create the file");
-            // Handle the error accordingly
-            return false;
-        }
-        fprintf(configFile, "[%s]\n", desiredSection.c_str());
-        fprintf(configFile, "%s=%s\n", desiredKey.c_str(), desiredValue.c_str());
-        fclose(configFile);
-        // printf("INI file created successfully.\n");
-        return true;
+        lines = { "[" + desiredSection + "]", desiredKey + "=" + desiredValue };
+        exists = true;
+        return;
     }
 
+    std::vector<std::string> newLines;
+    newLines.reserve(lines.size() + 2);
     std::string trimmedLine;
-    std::string tempPath = fileToEdit + ".tmp";
-    FILE* tempFile = fopen(tempPath.c_str(), "w");
+    std::string currentSection;
+    const std::string formattedDesiredValue = removeQuotes(desiredValue);
+    bool sectionFound = false;
+    bool keyFound = false;
+    for (const auto& line : lines) {
+        trimmedLine = trim(line);
+
+        // Check if the line represents a section
+        if (!trimmedLine.empty() && trimmedLine[0] == '[' && trimmedLine[trimmedLine.length() - 1] == ']') {
+            currentSection = removeQuotes(trim(std::string(trimmedLine.c_str() + 1, trimmedLine.length() - 2)));
+
+            if (sectionFound && !keyFound && (desiredNewKey.empty())) {
+                // Write the modified line with the desired key and value
+                newLines.push_back(desiredKey + "=" + formattedDesiredValue);
+                keyFound = true;
+            }
+        }
 
-    if (tempFile) {
-        std::string currentSection;
-        std::string formattedDesiredValue = removeQuotes(desiredValue);
-        constexpr size_t BufferSize = 4096;
-        char line[BufferSize];
-        bool sectionFound = false;
-        //bool sectionOutOfBounds = false;
-        bool keyFound = false;
-        while (fgets(line, sizeof(line), configFile)) {
-            trimmedLine = trim(std::string(line));
-
-            // Check if the line represents a section
-            if (trimmedLine[0] == '[' && trimmedLine[trimmedLine.length() - 1] == ']') {
-                currentSection = removeQuotes(trim(std::string(trimmedLine.c_str() + 1, trimmedLine.length() - 2)));
-                
-                if (sectionFound && !keyFound && (desiredNewKey.empty())) {
-                    // Write the modified line with the desired key and value
-                    formattedDesiredValue = removeQuotes(desiredValue);
-                    fprintf(tempFile, "%s=%s\n", desiredKey.c_str(), formattedDesiredValue.c_str());
-                    keyFound = true;
-                }
-                
+        if (sectionFound && !keyFound && desiredNewKey.empty()) {
+            if (trim(currentSection) != trim(desiredSection)) {
+                newLines.push_back(desiredKey + "=" + formattedDesiredValue);
+                keyFound = true;
             }
+        }
+
+        // Check if the line is in the desired section
+        if (trim(currentSection) == trim(desiredSection)) {
+            sectionFound = true;
+            // Tokenize the line based on "=" delimiter
+            std::string::size_type delimiterPos = trimmedLine.find('=');
+            if (delimiterPos != std::string::npos) {
+                std::string lineKey = trim(trimmedLine.substr(0, delimiterPos));
 
-            if (sectionFound && !keyFound && desiredNewKey.empty()) {
-                if (trim(currentSection) != trim(desiredSection)) {
-                    fprintf(tempFile, "%s=%s\n", desiredKey.c_str(), formattedDesiredValue.c_str());
+                // Check if the line key matches the desired key
+                if (lineKey == desiredKey) {
                     keyFound = true;
-                }
-            }
+                    std::string originalValue = getValueFromLine(trimmedLine); // Extract the original value
 
-            // Check if the line is in the desired section
-            if (trim(currentSection) == trim(desiredSection)) {
-                sectionFound = true;
-                // Tokenize the line based on "=" delimiter
-                std::string::size_type delimiterPos = trimmedLine.find('=');
-                if (delimiterPos != std::string::npos) {
-                    std::string lineKey = trim(trimmedLine.substr(0, delimiterPos));
-
-                    // Check if the line key matches the desired key
-                    if (lineKey == desiredKey) {
-                        keyFound = true;
-                        std::string originalValue = getValueFromLine(trimmedLine); // Extract the original value
-
-                        // Write the modified line with the desired key and value
-                        if (!desiredNewKey.empty()) {
-                            fprintf(tempFile, "%s=%s\n", desiredNewKey.c_str(), originalValue.c_str());
-                        } else {
-                            fprintf(tempFile, "%s=%s\n", desiredKey.c_str(), formattedDesiredValue.c_str());
-                        }
-                        continue; // Skip writing the original line
+                    // Write the modified line with the desired key and value
+                    if (!desiredNewKey.empty()) {
+                        newLines.push_back(desiredNewKey + "=" + originalValue);
+                    } else {
+                        newLines.push_back(desiredKey + "=" + formattedDesiredValue);
                     }
+                    continue; // Skip writing the original line
                 }
-            } 
-            
-            fprintf(tempFile, "%s", line);
-        }
-        
-        if (sectionFound && !keyFound && (desiredNewKey.empty())) {
-            // Write the modified line with the desired key and value
-            fprintf(tempFile, "%s=%s\n", desiredKey.c_str(), formattedDesiredValue.c_str());
-        }
-        
-        if (!sectionFound && !keyFound && desiredNewKey.empty()) {
-            // The desired section doesn't exist, so create it and add the key-value pair
-            fprintf(tempFile, "[%s]\n", desiredSection.c_str());
-            fprintf(tempFile, "%s=%s\n", desiredKey.c_str(), formattedDesiredValue.c_str());
+            }
         }
-        fclose(configFile);
-        fclose(tempFile);
-        remove(fileToEdit.c_str()); // Delete the old configuration file
-        rename(tempPath.c_str(), fileToEdit.c_str()); // Rename the temp file to the original name
-
-        // printf("INI file updated successfully.\n");
-        return true;
-    } else {
-        log("Failed to create temporary file.");
-        return false;
+
+        newLines.push_back(line);
     }
-    return false;
+
+    if (sectionFound && !keyFound && (desiredNewKey.empty())) {
+        // Write the modified line with the desired key and value
+        newLines.push_back(desiredKey + "=" + formattedDesiredValue);
+    }
+
+    if (!sectionFound && !keyFound && desiredNewKey.empty()) {
+        // The desired section doesn't exist, so create it and add the key-value pair
+        newLines.push_back("[" + desiredSection + "]");
+        newLines.push_back(desiredKey + "=" + formattedDesiredValue);
+    }
+    lines = std::move(newLines);
+}
+
+bool setIniFile(const std::string& fileToEdit, const std::string& desiredSection, const std::string& desiredKey, const std::string& desiredValue, const std::string& desiredNewKey, bool clean = false) {
+    std::vector<std::string> lines;
+    bool exists = readIniLines(fileToEdit, lines);
+    setIniLines(lines, exists, desiredSection, desiredKey, desiredValue, desiredNewKey);
+    if (clean) {
+        cleanIniLines(lines);
+    }
+    return writeIniLines(fileToEdit, lines);
 }
 
 bool setIniFileValue(const std::string& fileToEdit, const std::string& desiredSection, const std::string& desiredKey, const std::string& desiredValue) {
-    bool result = setIniFile(fileToEdit, desiredSection, desiredKey, desiredValue, "");
-    cleanIniFormatting(fileToEdit);
-    return result;
+    return setIniFile(fileToEdit, desiredSection, desiredKey, desiredValue, "", true);
 }
 
 bool setIniFileKey(const std::string& fileToEdit, const std::string& desiredSection, const std::string& desiredKey, const std::string& desiredNewKey) {
-    bool result = setIniFile(fileToEdit, desiredSection, desiredKey, "", desiredNewKey);
-    cleanIniFormatting(fileToEdit);
-    return result;
+    return setIniFile(fileToEdit, desiredSection, desiredKey, "", desiredNewKey, true);
 }
 
-bool removeIniFileKey(const std::string& fileToEdit, const std::string& desiredSection, const std::string& desiredKey) {
-  std::ifstream file(fileToEdit);
-  std::string line, currentSection;
+// Returns whether a line was removed
+bool removeIniLines(std::vector<std::string>& lines, const std::string& desiredSection, const std::string& desiredKey) {
+  std::string currentSection;
   bool sectionFound = false;
+  bool removed = false;
   std::vector<std::string> newLines;
+  newLines.reserve(lines.size());
 
-  while (std::getline(file, line)) {
+  for (auto& line : lines) {
     // Remove leading and trailing whitespace
     if (line.find_first_not_of(" \r\n") != std::string::npos) {
         trimInPlace(line);
@@ -540,31 +544,34 @@ bool removeIniFileKey(const std::string& fileToEdit, const std::string& desiredS
           std::string keyInFile = line.substr(0, equalsPos);
           trimInPlace(keyInFile);
           if (keyInFile == desiredKey) {
+            removed = true;
             continue;
           }
         }
       }
-      newLines.push_back(line);
+      newLines.push_back(std::move(line));
     }
   }
+  lines = std::move(newLines);
+  return removed;
+}
 
-  file.close();
-  std::ofstream outfile(fileToEdit);
-  for (const auto& line : newLines) {
-    outfile << line << std::endl;
+bool removeIniFileKey(const std::string& fileToEdit, const std::string& desiredSection, const std::string& desiredKey) {
+  std::vector<std::string> lines;
+  // Nothing to remove from a file that isn't there or doesn't have the key
+  if (!readIniLines(fileToEdit, lines) || !removeIniLines(lines, desiredSection, desiredKey)) {
+    return true;
   }
-  outfile.close();
-
-  return true;
+  return writeIniLines(fileToEdit, lines);
 }
 
-std::string readIniValue(const std::string& filePath, const std::string& section, const std::string& key) {
-    std::ifstream file(filePath);
+std::string readIniLinesValue(const std::vector<std::string>& lines, const std::string& section, const std::string& key) {
     std::string line, currentSection;
     bool sectionFound = false;
 
-    while (std::getline(file, line)) {
+    for (const auto& rawLine : lines) {
         // Remove leading and trailing whitespace
+        line = rawLine;
         line.erase(0, line.find_first_not_of(" \r\n"));
         line.erase(line.find_last_not_of(" \r\n") + 1);
 
@@ -587,6 +594,12 @@ std::string readIniValue(const std::string& filePath, const std::string& section
     return ""; // Key not found
 }
 
+std::string readIniValue(const std::string& filePath, const std::string& section, const std::string& key) {
+    std::vector<std::string> lines;
+    readIniLines(filePath, lines);
+    return readIniLinesValue(lines, section, key);
+}
+
 std::vector<std::vector<int>> parseIntIniData (std::string input, bool skipFirstItem = true) {
     // Remove outer brackets
     input = input.substr(6, input.length() - 3);
@@ -1,9 +1,17 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
 #include <cstdio>
+#include <memory>
+#include <new>
 #include <string>
+#include <string_view>
+#include <vector>
 #include <sys/stat.h>
+#include <unordered_map>
 #include <jansson.h>
+#include <switch.h>
 
 class SafeJson {
 public:
@@ -18,35 +26,392 @@ private:
     json_t* _json{ nullptr };
 };
 
-SafeJson readJsonFromFile(const std::string& filePath) {
+// Parsed documents are kept by path and parsed again only after the file's size or mtime changed, so the
+// menus that look at the same package JSON for every item parse it once. Readers share the documents and
+// must not change them. The least recently used documents are dropped once the budget is used up; a
+// document still held by a reader stays alive until it is released. The menus clear the cache when they
+// close.
+struct JsonCacheEntry {
+    off_t size;
+    time_t mtime;
+    SafeJson root;
+    uint64_t lastUse;
+    size_t cost; // Estimated size of the parsed document
+};
+
+std::unordered_map<std::string, JsonCacheEntry> jsonCache;
+Mutex jsonCacheMutex;
+size_t jsonCacheSize = 0;   // Sum of the costs of the cached documents
+uint64_t jsonCacheClock = 0;
+// Parsed with Jansson, package lists take about 10 times their text, small objects up to 25 times
+const size_t jsonParsedSizeFactor = 12;
+const size_t jsonCacheBudget = 1024 * 1024;
+
+// Drops the cached document of filePath, for files about to be replaced
+void forgetJsonDocument(const std::string& filePath) {
+    mutexLock(&jsonCacheMutex);
+    auto it = jsonCache.find(filePath);
+    if (it != jsonCache.end()) {
+        jsonCacheSize -= it->second.cost;
+        jsonCache.erase(it);
+    }
+    mutexUnlock(&jsonCacheMutex);
+}
+
+void clearJsonCache() {
+    mutexLock(&jsonCacheMutex);
+    jsonCache.clear();
+    jsonCacheSize = 0;
+    mutexUnlock(&jsonCacheMutex);
+}
+
+// Makes room for a document of the given cost, the caller holds jsonCacheMutex
+void evictJsonDocuments(size_t cost) {
+    while (!jsonCache.empty() && jsonCacheSize + cost > jsonCacheBudget) {
+        auto oldest = jsonCache.begin();
+        for (auto it = jsonCache.begin(); it != jsonCache.end(); ++it) {
+            if (it->second.lastUse < oldest->second.lastUse) {
+                oldest = it;
+            }
+        }
+        jsonCacheSize -= oldest->second.cost;
+        jsonCache.erase(oldest);
+    }
+}
+
+SafeJson readJsonFromFile(const std::string& filePath, bool logErrors = true) {
     // Check if the file exists
     struct stat fileStat;
     if (stat(filePath.c_str(), &fileStat) != 0) {
-        log("ERROR: readJsonFromFile: failed to get stat for file \"%s\"", filePath.c_str());
+        if (logErrors) {
+            log("ERROR: readJsonFromFile: failed to get stat for file \"%s\"", filePath.c_str());
+        }
         return nullptr;
     }
 
+    mutexLock(&jsonCacheMutex);
+    auto it = jsonCache.find(filePath);
+    if (it != jsonCache.end()) {
+        if (it->second.size == fileStat.st_size && it->second.mtime == fileStat.st_mtime) {
+            it->second.lastUse = ++jsonCacheClock;
+            SafeJson root(it->second.root);
+            mutexUnlock(&jsonCacheMutex);
+            return root;
+        }
+        jsonCacheSize -= it->second.cost;
+        jsonCache.erase(it);
+    }
+    mutexUnlock(&jsonCacheMutex);
+
     // Open the file
     FILE* file = fopen(filePath.c_str(), "r");
     if (!file) {
-        log("ERROR: readJsonFromFile: failed to open file \"%s\"", filePath.c_str());
+        if (logErrors) {
+            log("ERROR: readJsonFromFile: failed to open file \"%s\"", filePath.c_str());
+        }
         return nullptr;
     }
 
     json_error_t error;
-    json_t* root = json_loadf(file, JSON_DECODE_ANY, &error);
+    SafeJson root(json_loadf(file, JSON_DECODE_ANY, &error));
+    fclose(file);
     if (!root) {
-        fclose(file);
-        log("ERROR: readJsonFromFile: failed to load file as json \"%s\"", filePath.c_str());
+        if (logErrors) {
+            log("ERROR: readJsonFromFile: failed to load file as json \"%s\"", filePath.c_str());
+        }
         return nullptr;
     }
 
-    // Clean up
-    fclose(file);
-
+    const size_t cost = static_cast<size_t>(fileStat.st_size) * jsonParsedSizeFactor;
+    if (cost <= jsonCacheBudget / 2) {
+        mutexLock(&jsonCacheMutex);
+        evictJsonDocuments(cost);
+        if (jsonCache.find(filePath) == jsonCache.end()) {
+            jsonCache.emplace(filePath, JsonCacheEntry{fileStat.st_size, fileStat.st_mtime, root, ++jsonCacheClock, cost});
+            jsonCacheSize += cost;
+        }
+        mutexUnlock(&jsonCacheMutex);
+    }
     return root;
 }
 
+// Catalogs (overlays.json, packages.json, ...) are arrays of objects of which a list only shows a few string
+// members. readJsonTable reads such a file in chunks and keeps just the requested members of each element,
+// back to back in one buffer, so memory and time follow the members used and no document is built.
+struct JsonTable {
+    static constexpr uint32_t missing = UINT32_MAX;
+    std::vector<std::string> columns;
+    std::string text;
+    std::vector<uint32_t> offsets; // Row by row, one per column into text, missing if there is no such string
+    std::vector<uint32_t> lengths;
+    size_t rows = 0;
+
+    bool has(size_t row, size_t column) const {
+        return offsets[row * columns.size() + column] != missing;
+    }
+    std::string_view get(size_t row, size_t column) const {
+        const size_t cell = row * columns.size() + column;
+        return offsets[cell] == missing ? std::string_view() : std::string_view(text).substr(offsets[cell], lengths[cell]);
+    }
+};
+
+class JsonStreamReader {
+public:
+    explicit JsonStreamReader(FILE* file) : _file(file) {}
+
+    int peek() {
+        return (_position < _size || fill()) ? static_cast<unsigned char>(_buffer[_position]) : -1;
+    }
+    int next() {
+        return (_position < _size || fill()) ? static_cast<unsigned char>(_buffer[_position++]) : -1;
+    }
+    void skipSpaces() {
+        int c;
+        while ((c = peek()) == ' ' || c == '\n' || c == '\r' || c == '\t') {
+            ++_position;
+        }
+    }
+
+    // Reads the string at the current position into out, or skips it if out is nullptr
+    bool readString(std::string* out) {
+        if (next() != '"') {
+            return false;
+        }
+        while (true) {
+            int c = next();
+            if (c == -1) {
+                return false;
+            }
+            if (c == '"') {
+                return true;
+            }
+            if (c == '\\') {
+                c = next();
+                switch (c) {
+                    case '"': case '\\': case '/': break;
+                    case 'b': c = '\b'; break;
+                    case 'f': c = '\f'; break;
+                    case 'n': c = '\n'; break;
+                    case 'r': c = '\r'; break;
+                    case 't': c = '\t'; break;
+                    case 'u': {
+                        uint32_t codePoint;
+                        if (!readHex4(codePoint)) {
+                            return false;
+                        }
+                        if (codePoint >= 0xD800 && codePoint < 0xDC00) {
+                            // High surrogate, the low one follows
+                            uint32_t low;
+                            if (next() != '\\' || next() != 'u' || !readHex4(low) || low < 0xDC00 || low >= 0xE000) {
+                                return false;
+                            }
+                            codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                        }
+                        if (out) {
+                            appendUtf8(*out, codePoint);
+                        }
+                        continue;
+                    }
+                    default:
+                        return false;
+                }
+            }
+            if (out) {
+                *out += static_cast<char>(c);
+            }
+        }
+    }
+
+    // Skips one value, nested ones included
+    bool skipValue() {
+        int depth = 0;
+        do {
+            skipSpaces();
+            int c = peek();
+            if (c == '"') {
+                if (!readString(nullptr)) {
+                    return false;
+                }
+            } else if (c == '{' || c == '[') {
+                ++_position;
+                ++depth;
+            } else if (c == '}' || c == ']') {
+                if (depth == 0) {
+                    return false;
+                }
+                ++_position;
+                --depth;
+            } else if (c == ',' || c == ':') {
+                if (depth == 0) {
+                    return false;
+                }
+                ++_position;
+            } else if (c == -1) {
+                return false;
+            } else {
+                // Number, true, false or null
+                while ((c = peek()) != -1 && c != ',' && c != ']' && c != '}' && c != ' ' && c != '\n' && c != '\r' && c != '\t') {
+                    ++_position;
+                }
+            }
+        } while (depth > 0);
+        return true;
+    }
+
+private:
+    bool fill() {
+        _position = 0;
+        _size = fread(_buffer, 1, sizeof(_buffer), _file);
+        return _size > 0;
+    }
+    bool readHex4(uint32_t& value) {
+        value = 0;
+        for (int i = 0; i < 4; ++i) {
+            const int c = next();
+            int digit;
+            if (c >= '0' && c <= '9') {
+                digit = c - '0';
+            } else if (c >= 'a' && c <= 'f') {
+                digit = c - 'a' + 10;
+            } else if (c >= 'A' && c <= 'F') {
+                digit = c - 'A' + 10;
+            } else {
+                return false;
+            }
+            value = (value << 4) | digit;
+        }
+        return true;
+    }
+    static void appendUtf8(std::string& out, uint32_t codePoint) {
+        if (codePoint < 0x80) {
+            out += static_cast<char>(codePoint);
+        } else if (codePoint < 0x800) {
+            out += static_cast<char>(0xC0 | (codePoint >> 6));
+            out += static_cast<char>(0x80 | (codePoint & 0x3F));
+        } else if (codePoint < 0x10000) {
+            out += static_cast<char>(0xE0 | (codePoint >> 12));
+            out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (codePoint & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (codePoint >> 18));
+            out += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (codePoint & 0x3F));
+        }
+    }
+
+    FILE* _file;
+    char _buffer[16 * 1024];
+    size_t _position = 0;
+    size_t _size = 0;
+};
+
+// Reads the given string members of each object in the array filePath holds. Elements that aren't objects
+// are skipped, members that aren't strings count as missing. Fails, with an empty table, if the file isn't
+// such an array.
+bool readJsonTable(const std::string& filePath, const std::vector<std::string>& columns, JsonTable& table) {
+    table = JsonTable();
+    table.columns = columns;
+    FILE* file = fopen(filePath.c_str(), "rb");
+    if (!file) {
+        log("ERROR: readJsonTable: failed to open file \"%s\"", filePath.c_str());
+        return false;
+    }
+    std::unique_ptr<JsonStreamReader> reader(new (std::nothrow) JsonStreamReader(file));
+    bool result = reader != nullptr;
+    std::string key, value;
+
+    auto readElements = [&]() {
+        reader->skipSpaces();
+        if (reader->next() != '[') {
+            return false;
+        }
+        reader->skipSpaces();
+        if (reader->peek() == ']') {
+            return true;
+        }
+        while (true) {
+            reader->skipSpaces();
+            if (reader->peek() != '{') {
+                if (!reader->skipValue()) {
+                    return false;
+                }
+            } else {
+                reader->next();
+                const size_t firstCell = table.offsets.size();
+                table.offsets.resize(firstCell + columns.size(), JsonTable::missing);
+                table.lengths.resize(firstCell + columns.size(), 0);
+                reader->skipSpaces();
+                if (reader->peek() == '}') {
+                    reader->next();
+                } else {
+                    while (true) {
+                        reader->skipSpaces();
+                        key.clear();
+                        if (!reader->readString(&key)) {
+                            return false;
+                        }
+                        reader->skipSpaces();
+                        if (reader->next() != ':') {
+                            return false;
+                        }
+                        reader->skipSpaces();
+                        const auto column = std::find(columns.begin(), columns.end(), key);
+                        if (column != columns.end() && reader->peek() == '"') {
+                            value.clear();
+                            if (!reader->readString(&value)) {
+                                return false;
+                            }
+                            // A repeated member replaces the earlier one, like in a parsed document
+                            for (size_t i = column - columns.begin(); i < columns.size(); ++i) {
+                                if (columns[i] == key) {
+                                    table.offsets[firstCell + i] = table.text.size();
+                                    table.lengths[firstCell + i] = value.size();
+                                }
+                            }
+                            table.text += value;
+                        } else if (!reader->skipValue()) {
+                            return false;
+                        } else if (column != columns.end()) {
+                            for (size_t i = column - columns.begin(); i < columns.size(); ++i) {
+                                if (columns[i] == key) {
+                                    table.offsets[firstCell + i] = JsonTable::missing;
+                                }
+                            }
+                        }
+                        reader->skipSpaces();
+                        const int c = reader->next();
+                        if (c == '}') {
+                            break;
+                        }
+                        if (c != ',') {
+                            return false;
+                        }
+                    }
+                }
+                ++table.rows;
+            }
+            reader->skipSpaces();
+            const int c = reader->next();
+            if (c == ']') {
+                return true;
+            }
+            if (c != ',') {
+                return false;
+            }
+        }
+    };
+
+    result = result && readElements();
+    fclose(file);
+    if (!result) {
+        log("ERROR: readJsonTable: \"%s\" isn't an array of objects", filePath.c_str());
+        table = JsonTable();
+        table.columns = columns;
+    }
+    return result;
+}
+
 // int editJSONfile (const char* jsonFilePath, const std::string& offsetStr) {
 //     // log("Entered editJSONfile");
 
@@ -191,13 +191,15 @@ private:
     std::vector<std::string> filesList, filesListOn, filesListOff, filterList, filterOnList, filterOffList;
     std::vector<std::vector<std::string>> commands;
     bool toggleState = false;
-    bool searchCurrent;
     tsl::elm::ListItem* savedItem = nullptr;
 
 public:
     SelectionOverlay(const std::string& file, const std::string& key = "", const std::vector<std::vector<std::string>>& cmds = {}, std::string footer = "") 
         : filePath(file), specificKey(key), footer(footer), commands(cmds) {}
-    ~SelectionOverlay() {}
+    ~SelectionOverlay() {
+        clearJsonCache();
+        clearLoadedCatalogs();
+    }
 
     virtual tsl::elm::Element* createUI() override {
         // log ("SelectionOverlay");
@@ -235,6 +237,7 @@ public:
         bool useSplitHeader = false;
         bool markCurKip = false;
         bool markCurIni = false;
+        bool useKipInfo = false;
         std::string ramPath = "";
         std::string sourceIni = "";
         std::string sectionIni = "";
@@ -275,6 +278,7 @@ public:
                     useJson = true;
                 } else if (cmd[0] == "kip_info") {
                     jsonPath = preprocessPath(cmd[1]);
+                    useKipInfo = true;
                 } else if (cmd[0] == "ram_info") {
                     ramPath = preprocessPath(cmd[1]);
                     ramInfo = true;
@@ -308,7 +312,8 @@ public:
         }
 
         // Get the list of files matching the pattern
-       
+        // The filters are compiled once and checked as each entry is found, so nothing is removed afterwards
+        const GlobExclusions filters(filterList);
         if (!useToggle) {
             if (useText) {
                 if (!isFileOrDirectory(textPath)) {
@@ -337,153 +342,84 @@ public:
                     rootFrame->setContent(list);
                     return rootFrame;
                 } else {
-                    std::string currentHex = ""; // Is used to mark current value from the kip
-                    bool detectSize = true;
-                    searchCurrent = markCurKip || markCurIni ? true : false;
-                    // create list of data in the json 
-                    auto jsonData = readJsonFromFile(jsonPath);
-                    if (jsonData && json_is_array(jsonData)) {
-                        size_t arraySize = json_array_size(jsonData);
-                        for (size_t i = 0; i < arraySize; ++i) {
-                            json_t* item = json_array_get(jsonData, i);
-                            if (item && json_is_object(item)) {
-                                json_t* keyValue = json_object_get(item, jsonKey.c_str());
-                                if (keyValue && json_is_string(keyValue)) {
-                                    std::string name;
-                                    json_t* hexValue = json_object_get(item, "hex");
-                                    json_t* decValue = json_object_get(item, "dec");
-                                    json_t* otherValue = json_object_get(item, "value");
-                                    bool hexOrDec = (hexValue || decValue);
-                                    bool hexOrDecOrVal = (hexOrDec || otherValue);
-                                    json_t* colorValue = json_object_get(item, "color");
-                                    if (markCurKip && hexOrDec && searchCurrent) {
-                                        const char* valueStr;
-                                        int hexLength;
-                                        if (hexValue) {
-                                            valueStr = json_string_value(hexValue);
-                                            hexLength = strlen(valueStr) / 2;
-                                            hexLength = std::max(hexLength, 1);
-                                        } else if (decValue) {
-                                            valueStr = json_string_value(decValue);
-                                            hexLength = 4;
-                                        }
-                                        if (detectSize) {
-                                            try {
-                                                detectSize = false;
-                                                const std::string CUST = "43555354";
-                                                currentHex = readHexDataAtOffset("/atmosphere/kips/loader.kip", CUST, std::stoul(offset), hexLength); // Read the data from kip with offset starting from 'C' in 'CUST'
-                                                if (decValue) {
-                                                    currentHex = std::to_string(reversedHexToInt(currentHex));
-                                                }
-                                            }
-                                            catch (const std::invalid_argument& ex) {
-                                                log("ERROR - %s:%d  - invalid offset value: \"%s\" in \"%s\"", __func__, __LINE__, offset.c_str(), jsonPath.c_str());
-                                            }
-                                        }
-                                        if (valueStr == currentHex) {
-                                            name = json_string_value(keyValue);
-                                            if (name.find(" - ") != std::string::npos) {
-                                                name = name +  " | " + checkmarkChar;
-                                            } else {   
-                                                name = name +  " - " + checkmarkChar;
-                                            }
-                                            searchCurrent = false;
-                                        }
-                                        else {
-                                            name = json_string_value(keyValue);
-                                        }
-                                    } else if (markCurIni && hexOrDecOrVal && searchCurrent) {
-                                        const char* iniValueStr; 
-                                        if (hexValue) {
-                                            iniValueStr = json_string_value(hexValue);
-                                        } else if (decValue) {
-                                            iniValueStr = json_string_value(decValue);
-                                        } else {
-                                            iniValueStr = json_string_value(otherValue);
-                                        }
-                                        std::string iniValue = readIniValue(sourceIni, sectionIni, keyIni);
-                                        if (iniValueStr == iniValue) {
-                                            name = json_string_value(keyValue);
-                                            if (name.find(" - ") != std::string::npos) {
-                                                name = name +  " | " + checkmarkChar;
-                                            } else {   
-                                                name = name +  " - " + checkmarkChar;
-                                            }
-                                            searchCurrent = false;
-                                        }
-                                        else {
-                                            name = json_string_value(keyValue);
-                                        }
-                                    } else {
-                                            name = json_string_value(keyValue);
-                                    }
-                                    if (colorValue) {
-                                        name = name + " ::" + json_string_value(colorValue);
-                                    }
-                                    filesList.push_back(name);
+                    // create list of data in the json, from its catalog of the members the list shows
+                    enum { NameColumn, HexColumn, DecColumn, ValueColumn, ColorColumn };
+                    auto catalog = getCatalog(jsonPath, {jsonKey, "hex", "dec", "value", "color"});
+                    const JsonTable noTable;
+                    const JsonTable& jsonTable = catalog ? catalog->table : noTable;
+                    // The current value is read once and looked up in the catalog's index. The first entry with a
+                    // value tells which member to match and, for the kip, how many bytes to read.
+                    long currentRow = -1;
+                    for (size_t row = 0; row < jsonTable.rows && (markCurKip || markCurIni); ++row) {
+                        const bool hasHex = jsonTable.has(row, HexColumn), hasDec = jsonTable.has(row, DecColumn);
+                        if (!jsonTable.has(row, NameColumn) || !(hasHex || hasDec || (markCurIni && jsonTable.has(row, ValueColumn)))) {
+                            continue;
+                        }
+                        const int column = hasHex ? HexColumn : (hasDec ? DecColumn : ValueColumn);
+                        std::string currentValue;
+                        if (markCurKip) {
+                            const int hexLength = hasHex ? std::max(static_cast<int>(jsonTable.get(row, HexColumn).size() / 2), 1) : 4;
+                            try {
+                                const std::string CUST = "43555354";
+                                currentValue = readHexDataAtOffset("/atmosphere/kips/loader.kip", CUST, std::stoul(offset), hexLength); // Read the data from kip with offset starting from 'C' in 'CUST'
+                                if (!hasHex && !currentValue.empty()) {
+                                    currentValue = std::to_string(reversedHexToInt(currentValue));
                                 }
                             }
+                            catch (const std::invalid_argument& ex) {
+                                log("ERROR - %s:%d  - invalid offset value: \"%s\" in \"%s\"", __func__, __LINE__, offset.c_str(), jsonPath.c_str());
+                            }
+                        } else {
+                            currentValue = readIniValue(sourceIni, sectionIni, keyIni);
+                        }
+                        if (!currentValue.empty()) {
+                            currentRow = catalog->find(column, currentValue);
+                        }
+                        break;
+                    }
+                    for (size_t row = 0; row < jsonTable.rows; ++row) {
+                        if (!jsonTable.has(row, NameColumn)) {
+                            continue;
+                        }
+                        std::string name(jsonTable.get(row, NameColumn));
+                        if (static_cast<long>(row) == currentRow) {
+                            if (name.find(" - ") != std::string::npos) {
+                                name = name +  " | " + checkmarkChar;
+                            } else {   
+                                name = name +  " - " + checkmarkChar;
+                            }
+                        }
+                        if (jsonTable.has(row, ColorColumn)) {
+                            name = name + " ::" + std::string(jsonTable.get(row, ColorColumn));
+                        }
+                        if (!filters.excludes(name)) {
+                            filesList.push_back(name);
                         }
                     }
                 }
+            } else if (useSource && useKipInfo && isBackupListPattern(pathPattern)) {
+                // Kip backups come from their index, already in order
+                filesList = listBackups(pathPattern, filters);
             } else if (useFilter || useSource) {
-                filesList = getFilesListByWildcards(pathPattern);
-                std::sort(filesList.begin(), filesList.end(), [](const std::string& a, const std::string& b) {
-                    return getNameFromPath(a) < getNameFromPath(b);
-                });
+                // Filtered paths are skipped during the walk
+                filesList = getFilesListByWildcards(pathPattern, filters);
+                sortPathsByName(filesList);
             }
         } else {
-            filesListOn = getFilesListByWildcards(pathPatternOn);
-            filesListOff = getFilesListByWildcards(pathPatternOff);
-            
-            // Apply On Filter
-            for (const auto& filterOnPath : filterOnList) {
-                removeEntryFromList(filterOnPath, filesListOn);
-            }
-            // Apply Off Filter
-            for (const auto& filterOnPath : filterOffList) {
-                removeEntryFromList(filterOnPath, filesListOff);
-            }
-            
-            
-            // remove filterOnPath from filesListOn
-            // remove filterOffPath from filesListOff
-            
-            
+            // The On and Off filters are applied while walking, together with the common ones
+            filterOnList.insert(filterOnList.end(), filterList.begin(), filterList.end());
+            filterOffList.insert(filterOffList.end(), filterList.begin(), filterList.end());
+            filesListOn = getFilesListByWildcards(pathPatternOn, filterOnList);
+            filesListOff = getFilesListByWildcards(pathPatternOff, filterOffList);
+
             filesList.reserve(filesListOn.size() + filesListOff.size());
             filesList.insert(filesList.end(), filesListOn.begin(), filesListOn.end());
             filesList.insert(filesList.end(), filesListOff.begin(), filesListOff.end());
-            if (useSplitHeader) {
-                std::sort(filesList.begin(), filesList.end(), [](const std::string& a, const std::string& b) {
-                    std::string parentDirA = getParentDirNameFromPath(a);
-                    std::string parentDirB = getParentDirNameFromPath(b);
-                
-                    // Compare parent directory names
-                    if (parentDirA != parentDirB) {
-                        return parentDirA < parentDirB;
-                    } else {
-                        // Parent directory names are the same, compare filenames
-                        std::string filenameA = getNameFromPath(a);
-                        std::string filenameB = getNameFromPath(b);
-                
-                        // Compare filenames
-                        return filenameA < filenameB;
-                    }
-                });
-            } else {
-                std::sort(filesList.begin(), filesList.end(), [](const std::string& a, const std::string& b) {
-                    return getNameFromPath(a) < getNameFromPath(b);
-                });
-            }
+            sortPathsByName(filesList, useSplitHeader);
 
             
         }
         
-        // Apply filter
-        for (const auto& filterPath : filterList) {
-            removeEntryFromList(filterPath, filesList);
-        }
-        
         // Add each file as a menu item
         int count = 0;
         std::string jsonSep = "";
@@ -624,7 +560,8 @@ public:
                                 if (!prevValue.empty()) {
                                     listItem->setValue(prevValue);
                                 }
-                                std::vector<std::vector<std::string>> modifiedCommands = getModifyCommands(commands, file);
+                                // A delta backup is written out in full, so commands act on it like on any kip
+                                std::vector<std::vector<std::string>> modifiedCommands = getModifyCommands(commands, getBackupViewPath(file));
                                 int result = interpretAndExecuteCommand(modifiedCommands);
                                 if (result == 0) {
                                     listItem->setValue("DONE", tsl::PredefinedColors::Green);
@@ -798,7 +735,10 @@ protected:
 
 public:
     SubMenu(const std::string& path) : subPath(path) {}
-    ~SubMenu() {}
+    ~SubMenu() {
+        clearJsonCache();
+        clearLoadedCatalogs();
+    }
 
     FILE* kipFile = nullptr;
     int custOffset;
@@ -843,123 +783,82 @@ public:
         return slider;
     }
 
+    // Name of the catalog row at matchRow without its footer, or the arrow if there is none
+    static std::string getCurrentName(const Catalog& catalog, long matchRow) {
+        if (matchRow < 0 || !catalog.table.has(matchRow, 0)) {
+            return "\u25B6";
+        }
+        std::string cur_name(catalog.table.get(matchRow, 0));
+        size_t footer_pos = cur_name.find(" - ");
+        if (footer_pos != std::string::npos) {
+            cur_name.resize(footer_pos);
+        }
+        return cur_name;
+    }
+
     std::string findCurrentKip(const std::string& jsonPath, const std::string& offset) {
-        std::string searchKey;
-        const char* valueStr;
-
-        auto jsonData = readJsonFromFile(jsonPath);
-        if (jsonData && json_is_array(jsonData)) {
-            size_t arraySize = json_array_size(jsonData);
-            if (arraySize < 2) {
-                return "\u25B6";
-            }
-            json_t* item = json_array_get(jsonData, 1);
-            if (item && json_is_object(item)) {
-                json_t* hexValue = json_object_get(item, "hex");
-                json_t* decValue = json_object_get(item, "dec");
-                int hexLength = 0;
-                if ((hexValue && json_is_string(hexValue))) {
-                    valueStr = json_string_value(hexValue);
-                    searchKey = "hex";
-                    hexLength = strlen(valueStr) / 2;
-                    hexLength = std::max(hexLength, 1);
-                }
-                else if ((decValue && json_is_string(decValue))) {
-                    valueStr = json_string_value(decValue);
-                    searchKey = "dec";
-                    hexLength = 4;
-                }
-                else {
-                    return "\u25B6";
-                }
-                std::string currentHex;
-                try {
-                    const std::string CUST = "43555354";
-                    if (!kipFile) {
-                        kipFile = openFile("/atmosphere/kips/loader.kip");
-                        custOffset = findCustOffset(kipFile);
-                    }
-                    currentHex = readHexDataAtOffset(kipFile, CUST, std::stoul(offset), hexLength, custOffset);
-                }
-                catch (const std::invalid_argument& ex) {
-                    log("ERROR - %s:%d - invalid offset value: \"%s\" in \"%s\"", __func__, __LINE__, offset.c_str(), jsonPath.c_str());
-                }
-                if (!currentHex.empty()) {
-                    if (searchKey == "dec") {
-                        currentHex = std::to_string(reversedHexToInt(currentHex));
-                    }
-                    for (size_t i = 0; i < arraySize; ++i) {
-                        json_t* item = json_array_get(jsonData, i);
-                        if (item && json_is_object(item)) {
-                            json_t* searchItem = json_object_get(item, searchKey.c_str());
-                            if (searchItem && json_is_string(searchItem)) {
-                                if (json_string_value(searchItem) == currentHex) {
-                                    json_t* name = json_object_get(item, "name");
-                                    std::string cur_name = json_string_value(name);
-                                    size_t footer_pos = cur_name.find(" - ");
-                                    if (footer_pos != std::string::npos) {
-                                        cur_name.resize(footer_pos);
-                                    }
-                                    return cur_name;
-                                }
-                            }
-                        }
-                    }
-                }
+        enum { NameColumn, HexColumn, DecColumn };
+        auto loadedCatalog = getCatalog(jsonPath, {"name", "hex", "dec"});
+        if (!loadedCatalog || loadedCatalog->table.rows < 2) {
+            return "\u25B6";
+        }
+        const Catalog& catalog = *loadedCatalog;
+        // The second entry tells what the values are
+        int searchColumn;
+        int hexLength;
+        if (catalog.table.has(1, HexColumn)) {
+            searchColumn = HexColumn;
+            hexLength = std::max(static_cast<int>(catalog.table.get(1, HexColumn).size() / 2), 1);
+        } else if (catalog.table.has(1, DecColumn)) {
+            searchColumn = DecColumn;
+            hexLength = 4;
+        } else {
+            return "\u25B6";
+        }
+        std::string currentHex;
+        try {
+            const std::string CUST = "43555354";
+            if (!kipFile) {
+                kipFile = openFile("/atmosphere/kips/loader.kip");
+                custOffset = findCustOffset(kipFile);
             }
+            currentHex = readHexDataAtOffset(kipFile, CUST, std::stoul(offset), hexLength, custOffset);
         }
-        return "\u25B6";
+        catch (const std::invalid_argument& ex) {
+            log("ERROR - %s:%d - invalid offset value: \"%s\" in \"%s\"", __func__, __LINE__, offset.c_str(), jsonPath.c_str());
+        }
+        if (currentHex.empty()) {
+            return "\u25B6";
+        }
+        if (searchColumn == DecColumn) {
+            currentHex = std::to_string(reversedHexToInt(currentHex));
+        }
+        return getCurrentName(catalog, catalog.find(searchColumn, currentHex));
     }
 
     std::string findCurrentIni(const std::string& jsonPath, const std::string& iniPath, const std::string& section, const std::string& key) {
-        std::string searchKey;
-
-        auto jsonData = readJsonFromFile(jsonPath);
-        if (jsonData && json_is_array(jsonData)) {
-            size_t arraySize = json_array_size(jsonData);
-            if (arraySize < 2) {
-                return "\u25B6";
-            }
-            json_t* item = json_array_get(jsonData, 1);
-            if (item && json_is_object(item)) {
-                json_t* hexValue = json_object_get(item, "hex");
-                json_t* decValue = json_object_get(item, "dec");
-                json_t* otherValue = json_object_get(item, "value");
-                if ((hexValue && json_is_string(hexValue))) {
-                    searchKey = "hex";
-                }
-                else if ((decValue && json_is_string(decValue))) {
-                    searchKey = "dec";
-                }
-                else if ((otherValue && json_is_string(otherValue))) {
-                    searchKey = "value";
-                }
-                else {
-                    return "\u25B6";
-                }
-                std::string iniValue = readIniValue(iniPath, section, key);
-                if (!iniValue.empty()) {
-                    for (size_t i = 0; i < arraySize; ++i) {
-                        json_t* item = json_array_get(jsonData, i);
-                        if (item && json_is_object(item)) {
-                            json_t* searchItem = json_object_get(item, searchKey.c_str());
-                            if (searchItem && json_is_string(searchItem)) {
-                                if (json_string_value(searchItem) == iniValue) {
-                                    json_t* name = json_object_get(item, "name");
-                                    std::string cur_name = json_string_value(name);
-                                    size_t footer_pos = cur_name.find(" - ");
-                                    if (footer_pos != std::string::npos) {
-                                        cur_name.resize(footer_pos);
-                                    }
-                                    return cur_name;
-                                }
-                            }
-                        }
-                    }
-                }
-            }
+        enum { NameColumn, HexColumn, DecColumn, ValueColumn };
+        auto loadedCatalog = getCatalog(jsonPath, {"name", "hex", "dec", "value"});
+        if (!loadedCatalog || loadedCatalog->table.rows < 2) {
+            return "\u25B6";
+        }
+        const Catalog& catalog = *loadedCatalog;
+        // The second entry tells what the values are
+        int searchColumn;
+        if (catalog.table.has(1, HexColumn)) {
+            searchColumn = HexColumn;
+        } else if (catalog.table.has(1, DecColumn)) {
+            searchColumn = DecColumn;
+        } else if (catalog.table.has(1, ValueColumn)) {
+            searchColumn = ValueColumn;
+        } else {
+            return "\u25B6";
+        }
+        std::string iniValue = readIniValue(iniPath, section, key);
+        if (iniValue.empty()) {
+            return "\u25B6";
         }
-        return "\u25B6";
+        return getCurrentName(catalog, catalog.find(searchColumn, iniValue));
     }
 
     virtual tsl::elm::Element* createUI() override {
@@ -1004,7 +903,7 @@ public:
 
         if (!enableConfigNav) {
             std::vector<std::string> subdirectories = getSubdirectories(subPath);
-            std::sort(subdirectories.begin(), subdirectories.end());
+            sortPathsByName(subdirectories);
             for (const auto& subDirectory : subdirectories) {
                 if (isFileOrDirectory(subPath + subDirectory + '/' + configFileName)) {
                     auto item = new tsl::elm::ListItem(subDirectory);
@@ -1574,6 +1473,8 @@ public:
                     }
                 }
                 if (DownloadProcessing) {
+                    // The update changes the SD card and nothing below lists it, so clear the listings up front
+                    clearDirectoryCache();
                     std::string type = item.at("type");
                     std::string link = item.at("link");
                     std::string name = item.at("name");
@@ -1866,32 +1767,32 @@ public:
 
             if (!overlayFiles.empty()) {
                 std::map<std::string, std::map<std::string, std::string>> overlaysIniData = getParsedDataFromIniFile(overlaysIniFilePath);
-                std::multimap<int, std::string> order;
-                std::map<std::string, std::string> alpSort;
-
-                for (const std::string& sortElem : overlayFiles){
-                    auto [result, overlayName, overlayVersion] = getOverlayInfo(sortElem);
-                    if (result != ResultSuccess){
+                struct OverlayEntry {
+                    std::string key, fileName, name, version;
+                };
+                std::vector<OverlayEntry> overlayEntries;
+                std::multimap<int, size_t> order; // Index into overlayEntries, in name order for the same priority
+
+                // Each header is read once, the names are sorted in natural order with their keys
+                for (const std::string& overlayFile : overlayFiles) {
+                    overlayFileName = getNameFromPath(overlayFile);
+                    if (overlayFileName == "ovlmenu.ovl") {
                         continue;
                     }
-                    if (overlayName == "Uberhand"){
+                    auto [result, overlayName, overlayVersion] = getOverlayInfo(overlayFile);
+                    if (result != ResultSuccess || overlayName == "Uberhand") {
                         continue;
                     }
-                    alpSort[overlayName] = sortElem;
-                }
-                overlayFiles.clear();
-                for (const auto & overlay : alpSort) {
-                    overlayFiles.push_back(overlay.second);
+                    overlayEntries.push_back({getCollationKey(overlayName), overlayFileName, overlayName, overlayVersion});
                 }
+                std::sort(overlayEntries.begin(), overlayEntries.end(), [](const OverlayEntry& a, const OverlayEntry& b) {
+                    return a.key != b.key ? a.key < b.key : a.fileName < b.fileName;
+                });
 
-                for (const auto& overlayFile : overlayFiles) {
-                    overlayFileName = getNameFromPath(overlayFile);
+                for (size_t index = 0; index < overlayEntries.size(); ++index) {
+                    overlayFileName = overlayEntries[index].fileName;
                     int priority = 0;
 
-                    if (getNameFromPath(overlayFile) == "ovlmenu.ovl"){
-                        continue;
-                    }
-
                     if (overlaysIniData.find(overlayFileName) == overlaysIniData.end()) {
                         setIniFileValue(overlaysIniFilePath, overlayFileName, "priority", "0");
                     } else {
@@ -1902,18 +1803,14 @@ public:
                         } else
                             setIniFileValue(overlaysIniFilePath, overlayFileName, "priority", "0");  
                     }
-                    order.emplace(priority, overlayFileName);
+                    order.emplace(priority, index);
                 }
 
-                
-                
                 for (const auto & overlay : order) {
-                    overlayFileName = overlay.second;
+                    overlayFileName = overlayEntries[overlay.second].fileName;
+                    const std::string& overlayName = overlayEntries[overlay.second].name;
+                    const std::string& overlayVersion = overlayEntries[overlay.second].version;
 
-                    auto [result, overlayName, overlayVersion] = getOverlayInfo(overlayDirectory + overlayFileName);
-                    if (result != ResultSuccess)
-                        continue;
-                    
                     auto* listItem = new tsl::elm::ListItem(overlayName);
                     if (showOverlayVersions)
                         listItem->setValue(overlayVersion);
@@ -2060,7 +1957,7 @@ public:
             }
             std::multimap<int, std::string> order;
             std::map<std::string, std::map<std::string, std::string>> packagesIniData = getParsedDataFromIniFile(packagesIniFilePath);
-            std::sort(subdirectories.begin(), subdirectories.end());
+            sortPathsByName(subdirectories);
             for (const auto& taintedSubdirectory : subdirectories) {
                 priority = 0;
                 std::string subWithoutSpaces = taintedSubdirectory;
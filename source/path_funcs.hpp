@@ -4,8 +4,15 @@
 #include <ctime>
 #include <iostream>
 #include <fstream>
-#include <regex>
 #include <filesystem>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <new>
+#include <unistd.h>
+#include <cerrno>
+#include <map>
+#include "store_funcs.hpp"
 
 // Function to create a directory if it doesn't exist
 void createSingleDirectory(const std::string& directoryPath) {
@@ -15,38 +22,75 @@ void createSingleDirectory(const std::string& directoryPath) {
     }
 }
 
-// Function to create a directory (including nested directories) if it doesn't exist
-void createDirectory(const std::string& directoryPath) {
-    std::string path = directoryPath;
-
-    // Remove leading "sdmc:/" if present
-    if (path.substr(0, 6) == "sdmc:/") {
-        path = path.substr(6);
+// Function to create a directory (including nested directories) if it doesn't exist.
+// The deepest level is tried first and parents only on ENOENT, so an existing parent costs one mkdir.
+// Directories known to exist are remembered until the directory cache is cleared.
+bool createDirectory(const std::string& directoryPath) {
+    // Normalize to "sdmc:/a/b" without empty levels or a trailing slash
+    std::string path = "sdmc:";
+    path.reserve(directoryPath.size() + 6);
+    size_t pos = directoryPath.compare(0, 6, "sdmc:/") == 0 ? 6 : 0;
+    while (pos < directoryPath.size()) {
+        size_t next = directoryPath.find('/', pos);
+        if (next == std::string::npos) {
+            next = directoryPath.size();
+        }
+        if (next > pos) {
+            path += '/';
+            path.append(directoryPath, pos, next - pos);
+        }
+        pos = next + 1;
+    }
+    const size_t rootLength = 5; // "sdmc:"
+    if (path.size() == rootLength) {
+        return true;
     }
 
-    size_t pos = 0;
-    std::string token;
-    std::string parentPath = "sdmc:/";
+    mutexLock(&directoryCacheMutex);
+    const bool known = createdDirectories.count(path) != 0;
+    mutexUnlock(&directoryCacheMutex);
+    if (known) {
+        return true;
+    }
 
-    // Iterate through the path and create each directory level if it doesn't exist
-    while ((pos = path.find('/')) != std::string::npos) {
-        token = path.substr(0, pos);
-        if (token.empty()) {
-            // Skip empty tokens (e.g., consecutive slashes)
-            path.erase(0, pos + 1);
-            continue;
+    // Makes the level of path ending at levelEnd, cut off in place instead of copied. Returns 0 or errno.
+    auto makeLevel = [&path](size_t levelEnd) {
+        const bool cut = levelEnd < path.size();
+        if (cut) {
+            path[levelEnd] = '\0';
+        }
+        const int error = mkdir(path.c_str(), 0777) == 0 ? 0 : errno;
+        if (cut) {
+            path[levelEnd] = '/';
+        }
+        return error == EEXIST ? 0 : error;
+    };
+
+    std::vector<size_t> missingLevels;
+    size_t levelEnd = path.size();
+    int error;
+    while ((error = makeLevel(levelEnd)) == ENOENT) {
+        missingLevels.push_back(levelEnd);
+        levelEnd = path.rfind('/', levelEnd - 1);
+        if (levelEnd <= rootLength) {
+            error = 0;
+            break;
         }
-
-        parentPath += token + "/";
-        createSingleDirectory(parentPath); // Create the parent directory
-        path.erase(0, pos + 1);
     }
-
-    // Create the final directory level if it doesn't exist
-    if (!path.empty()) {
-        parentPath += path;
-        createSingleDirectory(parentPath); // Create the final directory
+    if (error != 0) {
+        return false;
+    }
+    while (!missingLevels.empty()) {
+        if (makeLevel(missingLevels.back()) != 0) {
+            return false;
+        }
+        missingLevels.pop_back();
     }
+
+    mutexLock(&directoryCacheMutex);
+    createdDirectories.insert(std::move(path));
+    mutexUnlock(&directoryCacheMutex);
+    return true;
 }
 
 
@@ -63,213 +107,564 @@ void createTextFile(const std::string& filePath, const std::string& content) {
 }
 
 
-void removeEntryFromList(const std::string& entry, std::vector<std::string>& fileList) {
-    fileList.erase(std::remove_if(fileList.begin(), fileList.end(), [&](const std::string& filePath) {
-        return filePath.compare(0, entry.length(), entry) == 0;
-    }), fileList.end());
+// mirror_copy records what it installed in "<source>.mirror" next to the source directory. Installing again
+// only copies the files that changed on either side, mirror_delete removes exactly the recorded files.
+struct MirrorRecord {
+    long long size;
+    time_t sourceTime;
+    time_t targetTime; // Right after the copy
+};
+
+struct MirrorManifest {
+    std::string target;
+    std::map<std::string, MirrorRecord> files; // By path relative to the source
+};
+
+std::string getMirrorManifestPath(const std::string& sourcePath) {
+    return removeEndingSlash(sourcePath) + ".mirror";
 }
 
+// Reads the manifest of the last mirror_copy from sourcePath, false if there is none
+bool readMirrorManifest(const std::string& sourcePath, MirrorManifest& manifest) {
+    std::ifstream file(getMirrorManifestPath(sourcePath));
+    if (!file || !std::getline(file, manifest.target)) {
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        // size<TAB>source mtime<TAB>target mtime<TAB>path
+        MirrorRecord record;
+        long long sourceTime, targetTime;
+        int pathStart = 0;
+        if (sscanf(line.c_str(), "%lld\t%lld\t%lld\t%n", &record.size, &sourceTime, &targetTime, &pathStart) == 3 && pathStart > 0) {
+            record.sourceTime = sourceTime;
+            record.targetTime = targetTime;
+            manifest.files[line.substr(pathStart)] = record;
+        }
+    }
+    return true;
+}
+
+bool writeMirrorManifest(const std::string& sourcePath, const MirrorManifest& manifest) {
+    FILE* file = fopen(getMirrorManifestPath(sourcePath).c_str(), "w");
+    if (!file) {
+        return false;
+    }
+    fprintf(file, "%s\n", manifest.target.c_str());
+    for (const auto& [path, record] : manifest.files) {
+        fprintf(file, "%lld\t%lld\t%lld\t%s\n", record.size, static_cast<long long>(record.sourceTime), static_cast<long long>(record.targetTime), path.c_str());
+    }
+    return fclose(file) == 0;
+}
 
 // Delete functions
-bool deleteFileOrDirectory(const std::string& pathToDelete) {
-    struct stat pathStat;
+// A delete job opens the SD card file system once, when its first directory is deleted, and closes it when done.
+// Paths inside a directory the job already deleted count as deleted: a recursive pattern can match both.
+struct DeleteJob {
+    FsFileSystem fsSdmc;
+    bool fsOpen = false;
+    std::vector<std::string> deletedDirectories; // Ending with '/'
+
+    DeleteJob() = default;
+    DeleteJob(const DeleteJob&) = delete;
+    DeleteJob& operator=(const DeleteJob&) = delete;
+    ~DeleteJob() {
+        if (fsOpen) {
+            fsFsClose(&fsSdmc);
+        }
+    }
 
-    if (isDirectory(pathToDelete)) {
-        FsFileSystem fsSdmc;
-        if (R_FAILED(fsOpenSdCardFileSystem(&fsSdmc))) {
-            log("Error accessing file system");
+    bool deletePath(const std::string& pathToDelete) {
+        for (const auto& directory : deletedDirectories) {
+            if (startsWith(pathToDelete, directory)) {
+                return true;
+            }
+        }
+        struct stat pathStat;
+        if (stat(pathToDelete.c_str(), &pathStat) != 0) {
             return false;
         }
-        if (R_FAILED(fsFsDeleteDirectoryRecursively(&fsSdmc, pathToDelete.c_str() + 5))) {
-            log("Error accessing deleting the folder \"%s\"", pathToDelete.c_str() + 5);
+        if (S_ISDIR(pathStat.st_mode)) {
+            if (!fsOpen) {
+                if (R_FAILED(fsOpenSdCardFileSystem(&fsSdmc))) {
+                    log("Error accessing file system");
+                    return false;
+                }
+                fsOpen = true;
+            }
+            forgetCreatedDirectories();
+            if (R_FAILED(fsFsDeleteDirectoryRecursively(&fsSdmc, pathToDelete.c_str() + 5))) {
+                log("Error accessing deleting the folder \"%s\"", pathToDelete.c_str() + 5);
+                return false;
+            }
+            deletedDirectories.push_back(pathToDelete.back() == '/' ? pathToDelete : pathToDelete + "/");
+            forgetContentHashes(pathToDelete);
+            return true;
+        } else if (S_ISREG(pathStat.st_mode)) {
+            if (std::remove(pathToDelete.c_str()) != 0) {
+                return false;
+            }
+            forgetContentHashes(pathToDelete);
+            return true;
+        }
+        return false;
+    }
+};
+
+// Progress of a delete is reported every deleteProgressBatch paths
+constexpr size_t deleteProgressBatch = 16;
+
+// Deletes the paths in order with one job and stops at the first failure.
+// With a list item the share of totalCommands this command stands for is shown as it goes.
+bool deletePaths(const std::vector<std::string>& paths, tsl::elm::ListItem* listItem = nullptr, int totalCommands = -1, int curProgress = -1) {
+    DeleteJob job;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        if (!job.deletePath(paths[i])) {
             return false;
         }
-        return true;
-    } else if (stat(pathToDelete.c_str(), &pathStat) == 0) {
-        if (S_ISREG(pathStat.st_mode)) {
-            if (std::remove(pathToDelete.c_str()) == 0) {
-                return true;
-                // Deletion successful
+        if (listItem != nullptr && totalCommands > 0 && ((i + 1) % deleteProgressBatch == 0 || i + 1 == paths.size())) {
+            const std::string progressStr = std::to_string(curProgress + static_cast<int>((i + 1) * 100 / (paths.size() * totalCommands))) + "%";
+            if (listItem->getValue() != progressStr) {
+                listItem->setValue(progressStr, tsl::PredefinedColors::Green);
             }
         }
     }
-    return false;
+    return true;
+}
+
+bool deleteFileOrDirectory(const std::string& pathToDelete) {
+    DeleteJob job;
+    return job.deletePath(pathToDelete);
 }
 
-bool deleteFileOrDirectoryByPattern(const std::string& pathPattern) {
+// Without a progress display each match is deleted as soon as the walk finds it. Showing progress needs the
+// number of matches, so then they are all found first.
+bool deleteFileOrDirectoryByPattern(const std::string& pathPattern, tsl::elm::ListItem* listItem = nullptr, int totalCommands = -1, int curProgress = -1) {
     //log("pathPattern: "+pathPattern);
-    std::vector<std::string> fileList = getFilesListByWildcards(pathPattern);
-    bool result = true;
-    for (const auto& path : fileList) {
-        //log("path: "+path);
-        result = result && deleteFileOrDirectory(path);
-        if (!result) {
-                return result;
-        }
+    if (listItem != nullptr && totalCommands > 0) {
+        return deletePaths(getFilesListByWildcards(pathPattern), listItem, totalCommands, curProgress);
     }
+    DeleteJob job;
+    bool result = true;
+    forEachGlobMatch(pathPattern, [&](const std::string& path) {
+        result = job.deletePath(path);
+        return result;
+    });
     return result;
 }
 
 bool mirrorDeleteFiles(const std::string& sourcePath, const std::string& targetPath="sdmc:/") {
+    MirrorManifest mirrorManifest;
+    if (readMirrorManifest(sourcePath, mirrorManifest) && mirrorManifest.target == removeEndingSlash(targetPath)) {
+        // Remove what the last mirror_copy installed, no need to walk the source
+        DeleteJob job;
+        for (const auto& [path, record] : mirrorManifest.files) {
+            const std::string updatedPath = mirrorManifest.target + "/" + path;
+            if (isFileOrDirectory(updatedPath) && !job.deletePath(updatedPath)) {
+                log("Failed to delete \"%s\"", updatedPath.c_str());
+                return false;
+            }
+        }
+        std::remove(getMirrorManifestPath(sourcePath).c_str());
+        return true;
+    }
+
     std::vector<std::string> fileList = getFilesListFromDirectory(sourcePath);
     bool result = true;
+    DeleteJob job;
     for (const auto& path : fileList) {
         // Generate the corresponding path in the target directory by replacing the source path
         std::string updatedPath = targetPath + path.substr(sourcePath.size());
         //log("mirror-delete: "+path+" "+updatedPath);
-        result = result && deleteFileOrDirectory(updatedPath);
+        result = result && job.deletePath(updatedPath);
         if (!result) {
             log("Failed to delete \"%s\"", updatedPath.c_str());
             return result;
         }
     }
+    std::remove(getMirrorManifestPath(sourcePath).c_str());
     return result;
 }
 
 
-// Move functions
-bool moveFileOrDirectory(const std::string& sourcePath, const std::string& destinationPath) {
-    struct stat sourceInfo;
-    struct stat destinationInfo;
-    
-    //log("sourcePath: "+sourcePath);
-    //log("destinationPath: "+destinationPath);
-    
-    if (stat(sourcePath.c_str(), &sourceInfo) == 0) {
-        // Source file or directory exists
+// Copy functions
+// Files are copied in large chunks. A file bigger than one chunk is pipelined: a reader thread fills one
+// buffer while the calling thread writes the other. The buffers are allocated on first use and released
+// when the command run ends.
+// A verified copy hashes the data as it is read, so checking it takes no second pass over the file.
+constexpr size_t copyChunkSize = 256 * 1024;
+
+Mutex copyBufferMutex;
+std::unique_ptr<char[]> copyBuffers[2];
+
+struct CopyPipeline {
+    FILE* source;
+    char* buffers[2];
+    size_t lengths[2] = {0, 0};
+    bool filled[2] = {false, false};
+    bool readError = false;
+    bool stop = false;
+    uint64_t* hash = nullptr; // Updated by the reader thread only
+    Mutex mutex;
+    CondVar condvar;
+};
+
+void copyReaderThread(void* arg) {
+    CopyPipeline* pipeline = static_cast<CopyPipeline*>(arg);
+    for (size_t slot = 0;; slot ^= 1) {
+        mutexLock(&pipeline->mutex);
+        while (pipeline->filled[slot] && !pipeline->stop) {
+            condvarWait(&pipeline->condvar, &pipeline->mutex);
+        }
+        const bool stop = pipeline->stop;
+        mutexUnlock(&pipeline->mutex);
+        if (stop) {
+            return;
+        }
 
-        // Check if the destination path exists
-        bool destinationExists = (stat(getParentDirFromPath(destinationPath).c_str(), &destinationInfo) == 0);
-        if (!destinationExists) {
-            // Create the destination directory
-            createDirectory(getParentDirFromPath(destinationPath));
-        } 
+        const size_t bytesRead = fread(pipeline->buffers[slot], 1, copyChunkSize, pipeline->source);
+        const bool readError = ferror(pipeline->source);
+        if (pipeline->hash) {
+            *pipeline->hash = fnv1aHash(pipeline->buffers[slot], bytesRead, *pipeline->hash);
+        }
 
-        if (S_ISDIR(sourceInfo.st_mode)) {
-            // Source path is a directory
-            DIR* dir = opendir(sourcePath.c_str());
-            if (!dir) {
-                //log("Failed to open source directory: "+sourcePath);
-                //printf("Failed to open source directory: %s\n", sourcePath.c_str());
-                return false;
-            }
+        mutexLock(&pipeline->mutex);
+        pipeline->lengths[slot] = bytesRead;
+        pipeline->readError = readError;
+        pipeline->filled[slot] = true;
+        condvarWakeAll(&pipeline->condvar);
+        mutexUnlock(&pipeline->mutex);
+        if (bytesRead < copyChunkSize) {
+            // End of file or read error
+            return;
+        }
+    }
+}
 
-            struct dirent* entry;
-            while ((entry = readdir(dir)) != NULL) {
-                const std::string fileOrFolderName = entry->d_name;
+// Writes everything the reader thread produces, returns the number of bytes written or -1 on error
+long long copyPipelined(FILE* srcFile, FILE* destFile, uint64_t* hash = nullptr) {
+    CopyPipeline pipeline;
+    pipeline.source = srcFile;
+    pipeline.hash = hash;
+    pipeline.buffers[0] = copyBuffers[0].get();
+    pipeline.buffers[1] = copyBuffers[1].get();
+    mutexInit(&pipeline.mutex);
+    condvarInit(&pipeline.condvar);
+
+    Thread reader;
+    if (R_FAILED(threadCreate(&reader, copyReaderThread, &pipeline, nullptr, 0x4000, 0x2C, -2)) || R_FAILED(threadStart(&reader))) {
+        log("Failed to start the copy reader thread");
+        return -1;
+    }
 
-                if (fileOrFolderName != "." && fileOrFolderName != "..") {
-                    std::string sourceFilePath = sourcePath + fileOrFolderName;
-                    std::string destinationFilePath = destinationPath + fileOrFolderName;
+    long long written = 0;
+    for (size_t slot = 0;; slot ^= 1) {
+        mutexLock(&pipeline.mutex);
+        while (!pipeline.filled[slot]) {
+            condvarWait(&pipeline.condvar, &pipeline.mutex);
+        }
+        const size_t length = pipeline.lengths[slot];
+        const bool readError = pipeline.readError;
+        mutexUnlock(&pipeline.mutex);
+
+        const bool writeError = length > 0 && fwrite(pipeline.buffers[slot], 1, length, destFile) != length;
+        mutexLock(&pipeline.mutex);
+        pipeline.filled[slot] = false;
+        pipeline.stop = writeError;
+        condvarWakeAll(&pipeline.condvar);
+        mutexUnlock(&pipeline.mutex);
+
+        if (readError || writeError) {
+            written = -1;
+            break;
+        }
+        written += length;
+        if (length < copyChunkSize) {
+            break;
+        }
+    }
+    threadWaitForExit(&reader);
+    threadClose(&reader);
+    return written;
+}
 
-                    if (entry->d_type == DT_DIR) {
-                        // Append trailing slash to destination path for folders
-                        destinationFilePath += "/";
-                        sourceFilePath += "/";
-                    }
+// Copies through a single buffer, returns the number of bytes written or -1 on error
+long long copyBuffered(FILE* srcFile, FILE* destFile, char* buffer, size_t bufferSize, uint64_t* hash = nullptr) {
+    long long written = 0;
+    size_t bytesRead;
+    while ((bytesRead = fread(buffer, 1, bufferSize, srcFile)) > 0) {
+        if (hash) {
+            *hash = fnv1aHash(buffer, bytesRead, *hash);
+        }
+        if (fwrite(buffer, 1, bytesRead, destFile) != bytesRead) {
+            return -1;
+        }
+        written += bytesRead;
+    }
+    return ferror(srcFile) ? -1 : written;
+}
 
-                    moveFileOrDirectory(sourceFilePath, destinationFilePath);
-                }
-            }
+// Copies the contents of srcFile to destFile, returns the number of bytes written or -1 on error.
+// Without a buffer of its own the shared buffers are used. With hash the data copied is hashed into it.
+long long copyFileContents(FILE* srcFile, FILE* destFile, long long size, char* buffer = nullptr, size_t bufferSize = 0, uint64_t* hash = nullptr) {
+#ifndef __SWITCH__
+    // Host builds let the kernel copy, falling back to buffers where that isn't supported
+    long long copied = 0;
+    while (copied < size && !hash) {
+        const ssize_t result = copy_file_range(fileno(srcFile), nullptr, fileno(destFile), nullptr, size - copied, 0);
+        if (result <= 0) {
+            break;
+        }
+        copied += result;
+    }
+    if (copied == size) {
+        return copied;
+    } else if (copied > 0) {
+        return -1;
+    }
+#endif
 
-            closedir(dir);
+    if (buffer) {
+        return copyBuffered(srcFile, destFile, buffer, bufferSize, hash);
+    }
 
-            // Delete the source directory
-            deleteFileOrDirectory(sourcePath);
+    mutexLock(&copyBufferMutex);
+    if (!copyBuffers[0]) {
+        copyBuffers[0].reset(new (std::nothrow) char[copyChunkSize]);
+        copyBuffers[1].reset(new (std::nothrow) char[copyChunkSize]);
+        if (!copyBuffers[0] || !copyBuffers[1]) {
+            copyBuffers[0].reset();
+            copyBuffers[1].reset();
+            mutexUnlock(&copyBufferMutex);
+            log("Failed to allocate copy buffers");
+            return -1;
+        }
+    }
 
-            return true;
-        } else {
-            // Source path is a regular file
-            std::string filename = getNameFromPath(sourcePath);
+    long long written;
+    if (size > static_cast<long long>(copyChunkSize)) {
+        written = copyPipelined(srcFile, destFile, hash);
+    } else {
+        written = copyBuffered(srcFile, destFile, copyBuffers[0].get(), copyChunkSize, hash);
+    }
+    mutexUnlock(&copyBufferMutex);
+    return written;
+}
 
-            std::string destinationFilePath = destinationPath;
+void releaseCopyBuffers() {
+    mutexLock(&copyBufferMutex);
+    copyBuffers[0].reset();
+    copyBuffers[1].reset();
+    mutexUnlock(&copyBufferMutex);
+}
 
-            if (destinationPath[destinationPath.length() - 1] == '/') {
-                destinationFilePath += filename;
-            }
-            
-            
-            //log("sourcePath: "+sourcePath);
-            //log("destinationFilePath: "+destinationFilePath);
-            
-            deleteFileOrDirectory(destinationFilePath); // delete destiantion file for overwriting
-            if (rename(sourcePath.c_str(), destinationFilePath.c_str()) == -1) {
-                //printf("Failed to move file: %s\n", sourcePath.c_str());
-                //log("Failed to move file: "+sourcePath);
-                return false;
-            }
+// With verify the data read from the source is hashed, and the copy fails unless the target reads back
+// with the same hash and size, and the source's recorded content hash, if any, matches too. Sources without
+// a record get one for the next copy.
+bool copySingleFile(const std::string& fromFile, const std::string& toFile, char* buffer = nullptr, size_t bufferSize = 0, bool verify = false) {
+    FILE* srcFile = fopen(fromFile.c_str(), "rb");
+    if (!srcFile) {
+        log("Failed to open \"%s\"", fromFile.c_str());
+        return false;
+    }
+    FILE* destFile = fopen(toFile.c_str(), "wb");
+    if (!destFile) {
+        fclose(srcFile);
+        log("Failed to create \"%s\"", toFile.c_str());
+        return false;
+    }
 
-            return true;
+    struct stat srcInfo;
+    const bool hasInfo = fstat(fileno(srcFile), &srcInfo) == 0;
+    const long long size = hasInfo ? srcInfo.st_size : 0;
+    // Reserving the whole file up front saves growing it chunk by chunk and fails early on a full card
+    bool result = ftruncate(fileno(destFile), size) == 0;
+    long long written = -1;
+    uint64_t hash = fnv1aOffsetBasis;
+    if (result) {
+        written = copyFileContents(srcFile, destFile, size, buffer, bufferSize, verify ? &hash : nullptr);
+        // The source may have changed size since it was opened
+        result = written >= 0 && (written == size || (fflush(destFile) == 0 && ftruncate(fileno(destFile), written) == 0));
+    }
+
+    fclose(srcFile);
+    result = (fclose(destFile) == 0) && result;
+    if (result && verify) {
+        uint64_t expectedHash, writtenHash;
+        struct stat destInfo;
+        if (!hasInfo || written != size) {
+            log("Verification failed: \"%s\" changed while it was copied", fromFile.c_str());
+            result = false;
+        } else if (findContentHash(fromFile, srcInfo, expectedHash) && expectedHash != hash) {
+            log("Verification failed: \"%s\" read back as %s, recorded as %s", fromFile.c_str(), hashToHex(hash).c_str(), hashToHex(expectedHash).c_str());
+            result = false;
+        } else if (stat(toFile.c_str(), &destInfo) != 0 || destInfo.st_size != size) {
+            log("Verification failed: \"%s\" is incomplete", toFile.c_str());
+            result = false;
+        } else if (!hashFileContent(toFile, writtenHash) || writtenHash != hash) {
+            // What ended up on the card, not just what was handed to it
+            log("Verification failed: \"%s\" doesn't read back as written", toFile.c_str());
+            result = false;
+        } else {
+            recordContentHash(fromFile, srcInfo, hash);
         }
     }
+    if (!result) {
+        log("Failed to copy \"%s\" to \"%s\"", fromFile.c_str(), toFile.c_str());
+        // Don't leave a partial file behind
+        std::remove(toFile.c_str());
+    }
+    return result;
+}
 
-    // Move unsuccessful or source file/directory doesn't exist
-    return false;
+// A previous copy is still current if the target holds the content of the source. Sizes and mtimes alone
+// can't tell two presets of the same size apart, the hashes come from the content index instead.
+bool isCopyUpToDate(const std::string& fromFile, const struct stat& fromInfo, const std::string& toFile) {
+    return hasSameContent(fromFile, fromInfo, toFile);
 }
 
-bool moveFilesOrDirectoriesByPattern(const std::string& sourcePathPattern, const std::string& destinationPath) {
-    std::vector<std::string> fileList = getFilesListByWildcards(sourcePathPattern);
-    bool result = true;
-    std::string fileListAsString;
-    for (const std::string& filePath : fileList) {
-        fileListAsString += filePath + "\n";
+// Tree copies are planned in one walk and then run by a small worker pool
+struct CopyJob {
+    std::string from;
+    std::string to;
+    long long size;
+    time_t time;
+};
+
+struct CopyManifest {
+    std::vector<std::string> directories; // Parents before their children
+    std::vector<CopyJob> files;
+};
+
+// Adds fromDirectory and everything below it to the manifest, mirrored to toDirectory (both end with '/').
+// A fromDirectory that can't be opened adds nothing. False if a directory below it can't be opened, the
+// manifest would then miss part of the tree.
+bool addTreeToManifest(const std::string& fromDirectory, const std::string& toDirectory, CopyManifest& manifest, bool skipUnchanged, bool isRoot = true) {
+    DIR* dir = opendir(fromDirectory.c_str());
+    if (dir == nullptr) {
+        if (!isRoot) {
+            log("Failed to open \"%s\"", fromDirectory.c_str());
+        }
+        return isRoot;
     }
-    //log("File List:\n" + fileListAsString);
-    
-    //log("pre loop");
-    // Iterate through the file list
-    for (const std::string& sourceFileOrDirectory : fileList) {
-        //log("sourceFileOrDirectory: "+sourceFileOrDirectory);
-        // if sourceFile is a file (Needs condition handling)
-        if (!isDirectory(sourceFileOrDirectory)) {
-            //log("destinationPath: "+destinationPath);
-            result = result && moveFileOrDirectory(sourceFileOrDirectory, destinationPath);
-            if (!result) {
-                return result;
-            }
-        } else if (isDirectory(sourceFileOrDirectory)) {
-            // if sourceFile is a directory (needs conditoin handling)
-            std::string folderName = getNameFromPath(sourceFileOrDirectory);
-            std::string fixedDestinationPath = destinationPath + folderName + "/";
-        
-            //log("fixedDestinationPath: "+fixedDestinationPath);
-        
-            result = result && moveFileOrDirectory(sourceFileOrDirectory, fixedDestinationPath);
-            if (!result) {
-                return result;
+    manifest.directories.push_back(toDirectory);
+
+    std::vector<std::string> subdirectories;
+    dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        const std::string name = entry->d_name;
+        if (name == "." || name == "..") {
+            continue;
+        }
+        if (entry->d_type == DT_DIR) {
+            subdirectories.push_back(name);
+            continue;
+        }
+        const std::string fromPath = fromDirectory + name;
+        struct stat fromInfo;
+        if (stat(fromPath.c_str(), &fromInfo) != 0) {
+            continue;
+        }
+        if (S_ISDIR(fromInfo.st_mode)) {
+            subdirectories.push_back(name);
+        } else if (S_ISREG(fromInfo.st_mode)) {
+            std::string toPath = toDirectory + name;
+            if (!(skipUnchanged && isCopyUpToDate(fromPath, fromInfo, toPath))) {
+                manifest.files.push_back({fromPath, std::move(toPath), static_cast<long long>(fromInfo.st_size), fromInfo.st_mtime});
             }
         }
+    }
+    // Subdirectories are walked after closing this one to keep few directory handles open
+    closedir(dir);
 
+    for (const auto& name : subdirectories) {
+        if (!addTreeToManifest(fromDirectory + name + "/", toDirectory + name + "/", manifest, skipUnchanged, false)) {
+            return false;
+        }
     }
-    return result;
-    //log("post loop");
+    return true;
 }
 
+constexpr size_t copyWorkerCount = 2;
+constexpr size_t copyWorkerBufferSize = 64 * 1024;
+
+struct CopyPool {
+    const std::vector<CopyJob>* jobs;
+    std::atomic<size_t> next{0};
+    std::atomic<bool> failed{false};
+    bool verify = false;
+};
+
+// Takes jobs until all are taken or one failed, with the buffer if one is given
+void runCopyJobs(CopyPool* pool, char* buffer, size_t bufferSize) {
+    size_t index;
+    while (!pool->failed && (index = pool->next++) < pool->jobs->size()) {
+        const CopyJob& job = (*pool->jobs)[index];
+        if (!copySingleFile(job.from, job.to, buffer, bufferSize, pool->verify)) {
+            pool->failed = true;
+        }
+    }
+}
 
-// Copy functions
-bool copySingleFile(const std::string& fromFile, const std::string& toFile) {
-    FILE* srcFile = fopen(fromFile.c_str(), "rb");
-    FILE* destFile = fopen(toFile.c_str(), "wb");
-    if (srcFile && destFile) {
-        const size_t bufferSize = 8192;
-        char buffer[bufferSize];
-        size_t bytesRead;
+void copyWorkerThread(void* arg) {
+    CopyPool* pool = static_cast<CopyPool*>(arg);
+    std::unique_ptr<char[]> buffer(new (std::nothrow) char[copyWorkerBufferSize]);
+    if (buffer) {
+        runCopyJobs(pool, buffer.get(), copyWorkerBufferSize);
+    }
+}
 
-        while ((bytesRead = fread(buffer, 1, bufferSize, srcFile)) > 0) {
-            fwrite(buffer, 1, bytesRead, destFile);
+// Creates the manifest's directories, then copies its files. Files bigger than a copy chunk are copied
+// one after another by the calling thread with the pipelined copy, meanwhile the workers share out the
+// small files, largest first. Once done with the big files the calling thread helps with the small ones.
+bool runCopyManifest(const CopyManifest& manifest, bool verify = false) {
+    for (const auto& directory : manifest.directories) {
+        // Parents come first, so one mkdir per directory does
+        mkdir(directory.c_str(), 0777);
+    }
+
+    std::vector<CopyJob> largeFiles, smallFiles;
+    for (const auto& job : manifest.files) {
+        (job.size > static_cast<long long>(copyChunkSize) ? largeFiles : smallFiles).push_back(job);
+    }
+    std::sort(smallFiles.begin(), smallFiles.end(), [](const CopyJob& a, const CopyJob& b) {
+        return a.size > b.size;
+    });
+
+    CopyPool pool;
+    pool.jobs = &smallFiles;
+    pool.verify = verify;
+    Thread workers[copyWorkerCount];
+    size_t workerCount = 0;
+    if (smallFiles.size() > 1) {
+        for (; workerCount < std::min(copyWorkerCount, smallFiles.size() - 1); ++workerCount) {
+            if (R_FAILED(threadCreate(&workers[workerCount], copyWorkerThread, &pool, nullptr, 0x10000, 0x2C, -2))) {
+                break;
+            }
+            if (R_FAILED(threadStart(&workers[workerCount]))) {
+                threadClose(&workers[workerCount]);
+                break;
+            }
         }
+    }
 
-        fclose(srcFile);
-        fclose(destFile);
-    } else {
-        return false;
-        // Error opening files or performing copy action.
-        // Handle the error accordingly.
+    bool result = true;
+    for (const auto& job : largeFiles) {
+        if (pool.failed || !copySingleFile(job.from, job.to, nullptr, 0, verify)) {
+            result = false;
+            break;
+        }
     }
-    return true;
+    runCopyJobs(&pool, nullptr, 0);
+
+    for (size_t i = 0; i < workerCount; ++i) {
+        threadWaitForExit(&workers[i]);
+        threadClose(&workers[i]);
+    }
+    return result && !pool.failed;
 }
 
-bool copyFileOrDirectory(const std::string& fromFileOrDirectory, const std::string& toFileOrDirectory) {
+bool copyFileOrDirectory(const std::string& fromFileOrDirectory, const std::string& toFileOrDirectory, bool skipUnchanged = false, bool verify = false) {
     bool result = true;
     struct stat fromFileOrDirectoryInfo;
     if (stat(fromFileOrDirectory.c_str(), &fromFileOrDirectoryInfo) == 0) {
@@ -284,6 +679,10 @@ bool copyFileOrDirectory(const std::string& fromFileOrDirectory, const std::stri
                 std::string toDirectory = toFileOrDirectory;
                 std::string fileName = fromFile.substr(fromFile.find_last_of('/') + 1);
                 std::string toFilePath = toDirectory + fileName;
+                // Outside skip_applied only hashes already recorded are compared, no file is read for it
+                if (skipUnchanged ? isCopyUpToDate(fromFile, fromFileOrDirectoryInfo, toFilePath) : hasSameContent(fromFile, fromFileOrDirectoryInfo, toFilePath, true)) {
+                    return true;
+                }
 
                 // Create the destination directory if it doesn't exist
                 createDirectory(toDirectory);
@@ -293,9 +692,12 @@ bool copyFileOrDirectory(const std::string& fromFileOrDirectory, const std::stri
                     std::remove(toFilePath.c_str());
                 }
 
-                return copySingleFile(fromFile, toFilePath);
+                return copySingleFile(fromFile, toFilePath, nullptr, 0, verify);
             } else {
                 std::string toFile = toFileOrDirectory;
+                if (skipUnchanged ? isCopyUpToDate(fromFile, fromFileOrDirectoryInfo, toFile) : hasSameContent(fromFile, fromFileOrDirectoryInfo, toFile, true)) {
+                    return true;
+                }
                 // Destination is a file or doesn't exist
                 std::string toDirectory = toFile.substr(0, toFile.find_last_of('/'));
 
@@ -308,7 +710,7 @@ bool copyFileOrDirectory(const std::string& fromFileOrDirectory, const std::stri
                     std::remove(toFile.c_str());
                 }
 
-                return copySingleFile(fromFile, toFile);
+                return copySingleFile(fromFile, toFile, nullptr, 0, verify);
             }
         } else if (S_ISDIR(fromFileOrDirectoryInfo.st_mode)) {
             // Source is a directory
@@ -326,38 +728,9 @@ bool copyFileOrDirectory(const std::string& fromFileOrDirectory, const std::stri
                     //log("dirName: "+dirName);
                     //log("toDirPath: "+toDirPath);
 
-                    // Create the destination directory
-                    createDirectory(toDirPath);
-                    //mkdir(toDirPath.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
-
-                    // Open the source directory
-                    DIR* dir = opendir(fromDirectory.c_str());
-                    if (dir != nullptr) {
-                        dirent* entry;
-                        while ((entry = readdir(dir)) != nullptr) {
-                            std::string fileOrFolderName = entry->d_name;
-                            // handle cade for files
-                            if (fileOrFolderName != "." && fileOrFolderName != "..") {
-                                std::string fromFilePath = fromDirectory + fileOrFolderName;
-                                result = result && copyFileOrDirectory(fromFilePath, toDirPath);
-                                if (!result) {
-                                    closedir(dir);
-                                    return result;
-                                }
-                            }
-                            // handle case for subfolders within the from file path
-                            if (entry->d_type == DT_DIR && fileOrFolderName != "." && fileOrFolderName != "..") {
-                                std::string subFolderPath = fromDirectory + fileOrFolderName + "/";                          
-                                result = result && copyFileOrDirectory(subFolderPath, toDirPath);
-                                if (!result) {
-                                    closedir(dir);
-                                    return result;
-                                }
-                            }
-                            
-                        }
-                        closedir(dir);
-                    }  
+                    CopyManifest manifest;
+                    result = addTreeToManifest(fromDirectory.back() == '/' ? fromDirectory : fromDirectory + "/", toDirPath, manifest, skipUnchanged)
+                        && !manifest.directories.empty() && runCopyManifest(manifest, verify);
                 }
             }
         }
@@ -365,66 +738,254 @@ bool copyFileOrDirectory(const std::string& fromFileOrDirectory, const std::stri
     return result;
 }
 
-bool copyFileOrDirectoryByPattern(const std::string& sourcePathPattern, const std::string& toDirectory) {
-    std::vector<std::string> fileList = getFilesListByWildcards(sourcePathPattern);
-    bool result = true;
+// True if a walk for pathPattern may come across what is written to destinationPath during the walk
+bool isInsidePatternRoot(const std::string& pathPattern, const std::string& destinationPath) {
+    return startsWith(destinationPath, compileGlob(pathPattern).root);
+}
 
-    for (const std::string& sourcePath : fileList) {
+// Matches are copied as the walk finds them, unless the copies would land where the walk is still going
+bool copyFileOrDirectoryByPattern(const std::string& sourcePathPattern, const std::string& toDirectory, bool skipUnchanged = false, bool verify = false) {
+    bool result = true;
+    auto copyMatch = [&](const std::string& sourcePath) {
         //log("sourcePath: "+sourcePath);
         //log("toDirectory: "+toDirectory);
-        if (sourcePath != toDirectory){
-            result = result && copyFileOrDirectory(sourcePath, toDirectory);
-            if (!result) {
-                return result;
+        result = sourcePath != toDirectory && copyFileOrDirectory(sourcePath, toDirectory, skipUnchanged, verify);
+        return result;
+    };
+    if (isInsidePatternRoot(sourcePathPattern, toDirectory)) {
+        for (const std::string& sourcePath : getFilesListByWildcards(sourcePathPattern)) {
+            if (!copyMatch(sourcePath)) {
+                break;
             }
-        } else {
-            return false;
         }
-        
+    } else {
+        forEachGlobMatch(sourcePathPattern, copyMatch);
     }
     return result;
 }
 
-bool mirrorCopyFiles(const std::string& sourcePath, const std::string& targetPath="sdmc:/") {
-    std::vector<std::string> fileList = getFilesListFromDirectory(sourcePath);
-    bool result = true;
+bool mirrorCopyFiles(const std::string& sourcePath, const std::string& targetPath="sdmc:/", bool skipUnchanged = false, bool verify = false) {
+    if (sourcePath == targetPath) {
+        // Nothing to copy
+        log("mirror_copy: \"%s\" is its own target", sourcePath.c_str());
+        return true;
+    }
+    const std::string sourceDirectory = sourcePath.back() == '/' ? sourcePath : sourcePath + "/";
+    const std::string targetDirectory = targetPath.back() == '/' ? targetPath : targetPath + "/";
+    CopyManifest manifest;
+    if (!addTreeToManifest(sourceDirectory, targetDirectory, manifest, false)) {
+        return false;
+    }
+    if (manifest.directories.empty()) {
+        return true;
+    }
 
-    for (const auto& path : fileList) {
-        // Generate the corresponding path in the target directory by replacing the source path
-        std::string updatedPath = targetPath + path.substr(sourcePath.size());
-        if (path != updatedPath){
-            //log("mirror-copy: "+path+" "+updatedPath);
-            result = result && copyFileOrDirectory(path, updatedPath);
-            if (!result) {
-                return result;
+    // Files already installed from the same source that nobody touched since are left alone
+    MirrorManifest mirrorManifest;
+    const bool hadManifest = readMirrorManifest(sourcePath, mirrorManifest) && mirrorManifest.target == removeEndingSlash(targetPath);
+    if (!hadManifest) {
+        mirrorManifest = MirrorManifest();
+        mirrorManifest.target = removeEndingSlash(targetPath);
+    }
+    std::vector<CopyJob> upToDate;
+    auto isInstalled = [&](const CopyJob& job) {
+        auto it = mirrorManifest.files.find(job.from.substr(sourceDirectory.size()));
+        struct stat targetInfo;
+        if (it != mirrorManifest.files.end() && it->second.size == job.size && it->second.sourceTime == job.time
+            && stat(job.to.c_str(), &targetInfo) == 0 && targetInfo.st_size == job.size && targetInfo.st_mtime == it->second.targetTime) {
+            return true;
+        }
+        if (skipUnchanged) {
+            struct stat fromInfo{};
+            fromInfo.st_size = job.size;
+            fromInfo.st_mtime = job.time;
+            if (isCopyUpToDate(job.from, fromInfo, job.to)) {
+                // Not copied, but installed all the same
+                upToDate.push_back(job);
+                return true;
             }
-        } else {
-            return false;
         }
+        return false;
+    };
+    manifest.files.erase(std::remove_if(manifest.files.begin(), manifest.files.end(), isInstalled), manifest.files.end());
+
+    createDirectory(manifest.directories[0]);
+    if (!runCopyManifest(manifest, verify)) {
+        // Unknown which files made it, the next install copies everything again
+        std::remove(getMirrorManifestPath(sourcePath).c_str());
+        return false;
     }
-    return result;
+
+    if (hadManifest && manifest.files.empty() && upToDate.empty()) {
+        return true;
+    }
+
+    // Files that are gone from the source stay recorded, mirror_delete still removes them
+    manifest.files.insert(manifest.files.end(), upToDate.begin(), upToDate.end());
+    for (const auto& job : manifest.files) {
+        struct stat targetInfo;
+        if (stat(job.to.c_str(), &targetInfo) == 0) {
+            mirrorManifest.files[job.from.substr(sourceDirectory.size())] = {job.size, job.time, targetInfo.st_mtime};
+        }
+    }
+    if (!writeMirrorManifest(sourcePath, mirrorManifest)) {
+        log("Failed to write \"%s\"", getMirrorManifestPath(sourcePath).c_str());
+    }
+    return true;
+}
+
+// Move functions
+// A rename only works within one mount point, across them the source is copied and then deleted
+bool moveAcrossVolumes(const std::string& sourcePath, const std::string& destinationPath, bool isDirectory, bool verify = false) {
+    bool result;
+    if (isDirectory) {
+        CopyManifest manifest;
+        // The source is deleted afterwards, so all of it has to be copied
+        result = addTreeToManifest(sourcePath, destinationPath, manifest, false) && !manifest.directories.empty() && runCopyManifest(manifest, verify);
+    } else {
+        result = copySingleFile(sourcePath, destinationPath, nullptr, 0, verify);
+    }
+    return result && deleteFileOrDirectory(sourcePath);
 }
 
-bool generateBackup() {
-    int highestNumber = 0;
-    std::regex pattern(R"(Backup \[(\d+)\])");
-    namespace fs = std::filesystem;
-    if (!isDirectory("/atmosphere/kips/.bak/"))
-        createDirectory("/atmosphere/kips/.bak/");
-
-    for (const auto& entry : fs::directory_iterator("/atmosphere/kips/.bak/")) {
-        if (fs::is_regular_file(entry)) {
-            std::smatch match;
-            std::string filename = entry.path().filename().string();
-            if (std::regex_search(filename, match, pattern)) {
-                int number = std::stoi(match[1].str());
-                highestNumber = std::max(highestNumber, number);
+// Moves with a single rename where possible. A directory is only merged entry by entry into a destination
+// that already exists, and the entries that aren't there yet are renamed as a whole again.
+bool moveFileOrDirectory(const std::string& sourcePath, const std::string& destinationPath, bool verify = false) {
+    struct stat sourceInfo;
+    struct stat destinationInfo;
+    
+    //log("sourcePath: "+sourcePath);
+    //log("destinationPath: "+destinationPath);
+    
+    if (stat(sourcePath.c_str(), &sourceInfo) == 0) {
+        // Source file or directory exists
+
+        if (S_ISDIR(sourceInfo.st_mode)) {
+            // Source path is a directory
+            const std::string fromDirectory = removeEndingSlash(sourcePath);
+            const std::string toDirectory = removeEndingSlash(destinationPath);
+
+            if (stat(toDirectory.c_str(), &destinationInfo) != 0) {
+                // Nothing to merge with, move the whole directory at once
+                createDirectory(getParentDirFromPath(toDirectory));
+                forgetCreatedDirectories();
+                if (rename(fromDirectory.c_str(), toDirectory.c_str()) == 0) {
+                    forgetContentHashes(fromDirectory);
+                    return true;
+                } else if (errno == EXDEV) {
+                    return moveAcrossVolumes(fromDirectory + "/", toDirectory + "/", true, verify);
+                }
+                //log("Failed to move directory: "+sourcePath);
+                return false;
+            }
+
+            DIR* dir = opendir(sourcePath.c_str());
+            if (!dir) {
+                //log("Failed to open source directory: "+sourcePath);
+                //printf("Failed to open source directory: %s\n", sourcePath.c_str());
+                return false;
+            }
+
+            std::vector<std::pair<std::string, std::string>> entries;
+            struct dirent* entry;
+            while ((entry = readdir(dir)) != NULL) {
+                const std::string fileOrFolderName = entry->d_name;
+
+                if (fileOrFolderName != "." && fileOrFolderName != "..") {
+                    std::string sourceFilePath = fromDirectory + "/" + fileOrFolderName;
+                    std::string destinationFilePath = toDirectory + "/" + fileOrFolderName;
+
+                    if (entry->d_type == DT_DIR) {
+                        // Append trailing slash to destination path for folders
+                        destinationFilePath += "/";
+                        sourceFilePath += "/";
+                    }
+
+                    entries.emplace_back(std::move(sourceFilePath), std::move(destinationFilePath));
+                }
+            }
+
+            // Entries are moved once the listing is done, renaming while iterating can skip entries
+            closedir(dir);
+            bool result = true;
+            for (const auto& [sourceFilePath, destinationFilePath] : entries) {
+                result = moveFileOrDirectory(sourceFilePath, destinationFilePath, verify) && result;
+            }
+
+            // Delete the source directory, unless it still holds entries that failed to move
+            if (result) {
+                deleteFileOrDirectory(sourcePath);
+            }
+            return result;
+        } else {
+            // Source path is a regular file
+            std::string filename = getNameFromPath(sourcePath);
+
+            std::string destinationFilePath = destinationPath;
+
+            if (destinationPath[destinationPath.length() - 1] == '/') {
+                destinationFilePath += filename;
+            }
+            
+            
+            //log("sourcePath: "+sourcePath);
+            //log("destinationFilePath: "+destinationFilePath);
+            
+            if (rename(sourcePath.c_str(), destinationFilePath.c_str()) == 0) {
+                forgetContentHashes(sourcePath);
+                forgetContentHashes(destinationFilePath);
+                return true;
+            } else if (errno == EXDEV) {
+                createDirectory(getParentDirFromPath(destinationFilePath));
+                return moveAcrossVolumes(sourcePath, destinationFilePath, false, verify);
+            }
+
+            // The target is in the way or its directory is missing
+            if (stat(destinationFilePath.c_str(), &destinationInfo) == 0) {
+                deleteFileOrDirectory(destinationFilePath); // delete destiantion file for overwriting
+            } else {
+                createDirectory(getParentDirFromPath(destinationFilePath));
+            }
+            if (rename(sourcePath.c_str(), destinationFilePath.c_str()) == -1) {
+                //printf("Failed to move file: %s\n", sourcePath.c_str());
+                //log("Failed to move file: "+sourcePath);
+                return false;
             }
+            forgetContentHashes(sourcePath);
+            return true;
         }
     }
 
-    std::string backupName = "/atmosphere/kips/.bak/Backup [" + std::to_string(highestNumber + 1) + "].kip";
-    // Save current kip with the unique name
-    bool result = copyFileOrDirectory("/atmosphere/kips/loader.kip", backupName);
+    // Move unsuccessful or source file/directory doesn't exist
+    return false;
+}
+
+// Matches are moved as the walk finds them, unless they would be moved to where the walk is still going
+bool moveFilesOrDirectoriesByPattern(const std::string& sourcePathPattern, const std::string& destinationPath, bool verify = false) {
+    bool result = true;
+    auto moveMatch = [&](const std::string& sourceFileOrDirectory) {
+        //log("sourceFileOrDirectory: "+sourceFileOrDirectory);
+        if (sourceFileOrDirectory.back() != '/') {
+            //log("destinationPath: "+destinationPath);
+            result = moveFileOrDirectory(sourceFileOrDirectory, destinationPath, verify);
+        } else {
+            std::string folderName = getNameFromPath(sourceFileOrDirectory);
+            std::string fixedDestinationPath = destinationPath + folderName + "/";
+
+            //log("fixedDestinationPath: "+fixedDestinationPath);
+
+            result = moveFileOrDirectory(sourceFileOrDirectory, fixedDestinationPath, verify);
+        }
+        return result;
+    };
+    if (isInsidePatternRoot(sourcePathPattern, destinationPath)) {
+        for (const std::string& sourceFileOrDirectory : getFilesListByWildcards(sourcePathPattern)) {
+            if (!moveMatch(sourceFileOrDirectory)) {
+                break;
+            }
+        }
+    } else {
+        forEachGlobMatch(sourcePathPattern, moveMatch);
+    }
     return result;
-}
\ No newline at end of file
+}
@@ -0,0 +1,202 @@
+#pragma once
+#include <sys/stat.h>
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include "debug_funcs.hpp"
+#include "hash_funcs.hpp"
+
+// Index of content hashes of files on the SD card, so a file is only read again after it changed. Copies and
+// backups use it to skip writing content that is already in place. It holds no file data: installs and
+// backups stay plain files, as FAT has no links to share them. The store directory also holds caches that
+// are derived from files on the card.
+const std::string contentStorePath = "sdmc:/config/uberhand/store/";
+const std::string contentIndexPath = contentStorePath + "hashes.txt";
+
+struct ContentRecord {
+    long long size;
+    time_t mtime;
+    uint64_t hash;
+};
+
+struct ContentIndex {
+    bool loaded = false;
+    bool changed = false;
+    bool clockKnown = false;
+    time_t clockOffset = 0; // File system time minus system time
+    std::unordered_map<std::string, ContentRecord> records;
+};
+
+ContentIndex contentIndex;
+Mutex contentIndexMutex;
+
+void loadContentIndex() {
+    if (contentIndex.loaded) {
+        return;
+    }
+    contentIndex.loaded = true;
+
+    FILE* file = fopen(contentIndexPath.c_str(), "r");
+    if (!file) {
+        // Saving the index measures the clock offset
+        contentIndex.changed = true;
+        return;
+    }
+    // size<TAB>mtime<TAB>hash<TAB>path, and #clock<TAB>offset as measured when the index was saved
+    char line[1024];
+    while (fgets(line, sizeof(line), file)) {
+        long long size, mtime;
+        unsigned long long hash;
+        int pathStart = 0;
+        if (sscanf(line, "%lld\t%lld\t%llx\t%n", &size, &mtime, &hash, &pathStart) == 3 && pathStart > 0) {
+            std::string path = line + pathStart;
+            path.erase(path.find_last_not_of("\r\n") + 1);
+            contentIndex.records[path] = {size, static_cast<time_t>(mtime), hash};
+        } else if (sscanf(line, "#clock\t%lld", &mtime) == 1) {
+            contentIndex.clockOffset = mtime;
+            contentIndex.clockKnown = true;
+        }
+    }
+    fclose(file);
+    contentIndex.changed = !contentIndex.clockKnown;
+}
+
+// Writes the index back if records were added, changed or dropped since it was loaded. File times may not
+// follow the system clock (local time, unset clock), the index just written tells by how much.
+void saveContentIndex() {
+    mutexLock(&contentIndexMutex);
+    if (contentIndex.changed) {
+        mkdir(contentStorePath.c_str(), 0777);
+        FILE* file = fopen(contentIndexPath.c_str(), "w");
+        if (file) {
+            for (const auto& [path, record] : contentIndex.records) {
+                fprintf(file, "%lld\t%lld\t%016llx\t%s\n", record.size, static_cast<long long>(record.mtime), static_cast<unsigned long long>(record.hash), path.c_str());
+            }
+            struct stat indexInfo;
+            if (fflush(file) == 0 && fstat(fileno(file), &indexInfo) == 0) {
+                contentIndex.clockOffset = indexInfo.st_mtime - std::time(nullptr);
+                contentIndex.clockKnown = true;
+            }
+            if (contentIndex.clockKnown) {
+                fprintf(file, "#clock\t%lld\n", static_cast<long long>(contentIndex.clockOffset));
+            }
+            fclose(file);
+            contentIndex.changed = false;
+        } else {
+            log("Failed to write \"%s\"", contentIndexPath.c_str());
+        }
+    }
+    mutexUnlock(&contentIndexMutex);
+}
+
+bool hashFileContent(const std::string& filePath, uint64_t& hash) {
+    FILE* file = fopen(filePath.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    const size_t bufferSize = 64 * 1024;
+    std::unique_ptr<char[]> buffer(new (std::nothrow) char[bufferSize]);
+    if (!buffer) {
+        fclose(file);
+        return false;
+    }
+    hash = fnv1aOffsetBasis;
+    size_t bytesRead;
+    while ((bytesRead = fread(buffer.get(), 1, bufferSize, file)) > 0) {
+        hash = fnv1aHash(buffer.get(), bytesRead, hash);
+    }
+    const bool result = !ferror(file);
+    fclose(file);
+    return result;
+}
+
+// Recorded content hash of a file, if its size and mtime still match the record. A record that no longer
+// matches is dropped.
+bool findContentHash(const std::string& filePath, const struct stat& fileInfo, uint64_t& hash) {
+    mutexLock(&contentIndexMutex);
+    loadContentIndex();
+    auto it = contentIndex.records.find(filePath);
+    bool found = false;
+    if (it != contentIndex.records.end()) {
+        found = it->second.size == fileInfo.st_size && it->second.mtime == fileInfo.st_mtime;
+        if (found) {
+            hash = it->second.hash;
+        } else {
+            contentIndex.records.erase(it);
+            contentIndex.changed = true;
+        }
+    }
+    mutexUnlock(&contentIndexMutex);
+    return found;
+}
+
+// Drops the records of path and of everything below it, for files that were deleted or moved away
+void forgetContentHashes(const std::string& path) {
+    mutexLock(&contentIndexMutex);
+    loadContentIndex();
+    const std::string directory = path.back() == '/' ? path : path + "/";
+    for (auto it = contentIndex.records.begin(); it != contentIndex.records.end();) {
+        if (it->first == path || it->first.compare(0, directory.size(), directory) == 0) {
+            it = contentIndex.records.erase(it);
+            contentIndex.changed = true;
+        } else {
+            ++it;
+        }
+    }
+    mutexUnlock(&contentIndexMutex);
+}
+
+// FAT keeps mtimes in 2 second steps, so a file changed within the last few seconds could change again
+// with the same size and mtime. Until an index was saved the clock offset is unknown, any time within a
+// day could then be recent.
+bool isRecentlyModified(const struct stat& fileInfo) {
+    mutexLock(&contentIndexMutex);
+    loadContentIndex();
+    const time_t now = std::time(nullptr);
+    const bool recent = contentIndex.clockKnown ? fileInfo.st_mtime + 2 >= now + contentIndex.clockOffset : fileInfo.st_mtime + 24 * 60 * 60 >= now;
+    mutexUnlock(&contentIndexMutex);
+    return recent;
+}
+
+// Files changed within the last few seconds aren't recorded, a later change could go unnoticed
+void recordContentHash(const std::string& filePath, const struct stat& fileInfo, uint64_t hash) {
+    if (isRecentlyModified(fileInfo)) {
+        return;
+    }
+    mutexLock(&contentIndexMutex);
+    ContentRecord& record = contentIndex.records[filePath];
+    if (record.size != fileInfo.st_size || record.mtime != fileInfo.st_mtime || record.hash != hash) {
+        record = {static_cast<long long>(fileInfo.st_size), fileInfo.st_mtime, hash};
+        contentIndex.changed = true;
+    }
+    mutexUnlock(&contentIndexMutex);
+}
+
+// Content hash of a regular file. The file is only read if its size or mtime differ from the recorded ones.
+bool getContentHash(const std::string& filePath, const struct stat& fileInfo, uint64_t& hash) {
+    if (findContentHash(filePath, fileInfo, hash)) {
+        return true;
+    }
+    if (!hashFileContent(filePath, hash)) {
+        return false;
+    }
+    recordContentHash(filePath, fileInfo, hash);
+    return true;
+}
+
+// True if toFile exists with the same content as fromFile. Only hashes when the sizes match.
+// With recordedOnly nothing is read: files without a current record count as different.
+bool hasSameContent(const std::string& fromFile, const struct stat& fromInfo, const std::string& toFile, bool recordedOnly = false) {
+    struct stat toInfo;
+    uint64_t fromHash, toHash;
+    if (stat(toFile.c_str(), &toInfo) != 0 || !S_ISREG(toInfo.st_mode) || toInfo.st_size != fromInfo.st_size) {
+        return false;
+    }
+    if (recordedOnly) {
+        return findContentHash(fromFile, fromInfo, fromHash) && findContentHash(toFile, toInfo, toHash) && fromHash == toHash;
+    }
+    return getContentHash(fromFile, fromInfo, fromHash) && getContentHash(toFile, toInfo, toHash) && fromHash == toHash;
+}
@@ -1,5 +1,10 @@
 #pragma once
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
 #include <string>
+#include <string_view>
 
 constexpr const char* WhitespaceCharacters = " \t\n\r\f\v";
 
@@ -114,10 +119,52 @@ std::string getExtension(const std::string& filename) {
     return filename;
 }
 
+// Parses a decimal file offset, false unless the whole text is one
+bool parseOffset(const std::string& text, size_t& offset) {
+    if (text.empty() || !std::isdigit(static_cast<unsigned char>(text[0]))) {
+        return false;
+    }
+    errno = 0;
+    char* end;
+    const unsigned long long value = std::strtoull(text.c_str(), &end, 10);
+    if (*end != '\0' || errno == ERANGE || value > SIZE_MAX) {
+        return false;
+    }
+    offset = value;
+    return true;
+}
+
 bool startsWith(const std::string& str, const std::string& prefix) {
     return str.compare(0, prefix.length(), prefix) == 0;
 }
 
+// Sort key for a name: letters are compared without case and runs of digits by their value, so "mod2"
+// comes before "Mod10". A digit run becomes '0', its length without leading zeros and the digits.
+std::string getCollationKey(std::string_view name) {
+    std::string key;
+    key.reserve(name.size() + 4);
+    for (size_t i = 0; i < name.size();) {
+        const char character = name[i];
+        if (character < '0' || character > '9') {
+            key += (character >= 'A' && character <= 'Z') ? static_cast<char>(character - 'A' + 'a') : character;
+            ++i;
+            continue;
+        }
+        while (i + 1 < name.size() && name[i] == '0' && name[i + 1] >= '0' && name[i + 1] <= '9') {
+            ++i;
+        }
+        size_t end = i;
+        while (end < name.size() && name[end] >= '0' && name[end] <= '9') {
+            ++end;
+        }
+        key += '0';
+        key += static_cast<char>(std::min<size_t>(end - i, 255));
+        key.append(name.substr(i, end - i));
+        i = end;
+    }
+    return key;
+}
+
 // Path functions
 bool isDirectory(const std::string& path) {
     struct stat pathStat;
@@ -0,0 +1,555 @@
+#pragma once
+#include <get_funcs.hpp>
+#include <switch.h>
+#include <cctype>
+#include <climits>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Command argument templates
+//
+// An argument like "/switch/.packages/{json_source(*,label)}/{name}" is compiled once into
+// literal and placeholder segments and can then be rendered for every list item with a
+// single pass. Placeholder arguments are templates themselves, so nested placeholders such as
+// {json_data(0,assets,{json_source(*,download-entry)},name)} are resolved from the inside out.
+// A placeholder the current context can't resolve is written back unchanged, which lets
+// getModifyCommands() fill in the item values and the interpreter fill in the rest later.
+
+// Key list of a json_source / json_data lookup, compiled into typed steps once instead of on every lookup
+struct JsonPathStep {
+    enum Kind : uint8_t {
+        Key,         // Member of an object, or element of an array if the key is an index
+        FirstObject, // [] on an array
+        Selected     // * in json_source, the index of the selected item
+    };
+    Kind kind = Key;
+    std::string key;
+    size_t index = SIZE_MAX; // The key as an array index, SIZE_MAX if it isn't one
+};
+
+using JsonPath = std::vector<JsonPathStep>;
+
+size_t parseJsonIndex(std::string_view text) {
+    if (text.empty() || text.size() > 9 || text.find_first_not_of("0123456789") != std::string_view::npos) {
+        return SIZE_MAX;
+    }
+    size_t index = 0;
+    for (const char digit : text) {
+        index = index * 10 + (digit - '0');
+    }
+    return index;
+}
+
+JsonPath compileJsonPath(const std::vector<std::string>& keys, bool selectable) {
+    JsonPath path;
+    path.reserve(keys.size());
+    for (const auto& rawKey : keys) {
+        JsonPathStep step;
+        step.key = trim(rawKey);
+        if (selectable && step.key == "*") {
+            step.kind = JsonPathStep::Selected;
+        } else {
+            step.kind = step.key == "[]" ? JsonPathStep::FirstObject : JsonPathStep::Key;
+            step.index = parseJsonIndex(step.key);
+        }
+        path.push_back(std::move(step));
+    }
+    return path;
+}
+
+// selected is the selected item, the value of a * step
+bool getJsonValueByPath(json_t* root, const JsonPath& path, const std::string& selected, std::string& value) {
+    const std::string selectedKey = trim(selected);
+    json_t* current = root;
+    for (const auto& step : path) {
+        const std::string& key = step.kind == JsonPathStep::Selected ? selectedKey : step.key;
+        if (json_is_object(current)) {
+            current = json_object_get(current, key.c_str());
+        } else if (json_is_array(current)) {
+            if (step.kind == JsonPathStep::FirstObject) {
+                for (size_t index = 0; index < json_array_size(current); ++index) {
+                    json_t* arrayItem = json_array_get(current, index);
+                    if (json_is_object(arrayItem)) {
+                        current = arrayItem;
+                        break;
+                    }
+                }
+            } else {
+                const size_t index = step.kind == JsonPathStep::Selected ? parseJsonIndex(key) : step.index;
+                if (index >= json_array_size(current)) {
+                    return false;
+                }
+                current = json_array_get(current, index);
+            }
+        } else {
+            return false;
+        }
+    }
+
+    if (json_is_string(current)) {
+        value = json_string_value(current);
+        return true;
+    }
+    if (json_is_integer(current)) {
+        value = std::to_string(json_integer_value(current));
+        return true;
+    }
+    return false;
+}
+
+bool isJsonTemplateCall(const std::string& name) {
+    return name == "json_source" || name == "json_mark_cur_kip" || name == "json_mark_cur_ini" || name == "json_data";
+}
+
+struct TemplateNode;
+
+struct TemplateSegment {
+    std::string text;                // literal text or placeholder name
+    bool placeholder = false;
+    bool call = false;               // written as {name(arg, ...)}
+    std::vector<TemplateNode> args;
+    std::optional<JsonPath> jsonPath; // JSON lookups whose arguments have no placeholders, compiled when parsed
+};
+
+struct TemplateNode {
+    std::vector<TemplateSegment> segments;
+};
+
+// Lazily loaded JSON document used by json_source / json_data lookups, shared through the JSON cache
+class TemplateJson {
+public:
+    void setPath(const std::string& path) {
+        _path = path;
+        _root.reset();
+    }
+    // Drops the loaded document so the next lookup reads the file again
+    void reload() {
+        if (!_path.empty()) {
+            forgetJsonDocument(_path);
+        }
+        _root.reset();
+    }
+    bool empty() const { return _path.empty(); }
+    json_t* get() {
+        if (_path.empty()) {
+            return nullptr;
+        }
+        if (!_root) {
+            _root.emplace(readJsonFromFile(_path, false));
+        }
+        return *_root;
+    }
+private:
+    std::string _path;
+    std::optional<SafeJson> _root;
+};
+
+struct TemplateContext {
+    bool hasSource = false;
+    bool toggle = false;
+    bool on = true;
+    std::string source, name, parentName;
+    TemplateJson jsonSource;         // {json_source(...)}, {json_mark_cur_kip(...)}, {json_mark_cur_ini(...)}
+    TemplateJson jsonData;           // {json_data(...)}
+    std::unordered_map<std::string, std::string> variables;
+
+    void setSource(const std::string& file) {
+        hasSource = true;
+        source = file;
+        name = getNameFromPath(file);
+        parentName = getParentDirNameFromPath(file);
+    }
+};
+
+// Parsing
+size_t parseTemplatePlaceholder(const std::string& text, size_t pos, TemplateSegment& segment);
+
+// Reads segments until the end of the text or, inside placeholder arguments, until ',' or the closing ')'
+size_t parseTemplateSegments(const std::string& text, size_t pos, TemplateNode& node, bool inArgs) {
+    std::string literal;
+    int depth = 0;
+    while (pos < text.size()) {
+        const char c = text[pos];
+        if (c == '{') {
+            TemplateSegment segment;
+            const size_t end = parseTemplatePlaceholder(text, pos, segment);
+            if (end != std::string::npos) {
+                if (!literal.empty()) {
+                    node.segments.push_back({std::move(literal)});
+                    literal.clear();
+                }
+                node.segments.push_back(std::move(segment));
+                pos = end;
+                continue;
+            }
+        } else if (inArgs) {
+            if (c == '(') {
+                ++depth;
+            } else if (c == ')') {
+                if (depth == 0) {
+                    break;
+                }
+                --depth;
+            } else if (c == ',' && depth == 0) {
+                break;
+            }
+        }
+        literal += c;
+        ++pos;
+    }
+    if (!literal.empty()) {
+        node.segments.push_back({std::move(literal)});
+    }
+    return pos;
+}
+
+void compileTemplateJsonPath(TemplateSegment& segment) {
+    if (!isJsonTemplateCall(segment.text)) {
+        return;
+    }
+    std::vector<std::string> keys;
+    keys.reserve(segment.args.size());
+    for (const auto& arg : segment.args) {
+        if (arg.segments.size() > 1 || (arg.segments.size() == 1 && arg.segments[0].placeholder)) {
+            return;
+        }
+        keys.push_back(arg.segments.empty() ? std::string() : arg.segments[0].text);
+    }
+    segment.jsonPath = compileJsonPath(keys, segment.text != "json_data");
+}
+
+// Returns the position after the placeholder or npos if the text at pos isn't one
+size_t parseTemplatePlaceholder(const std::string& text, size_t pos, TemplateSegment& segment) {
+    size_t end = pos + 1;
+    while (end < text.size() && (std::isalnum(static_cast<unsigned char>(text[end])) || text[end] == '_')) {
+        ++end;
+    }
+    if (end == pos + 1 || end >= text.size()) {
+        return std::string::npos;
+    }
+    segment.text = text.substr(pos + 1, end - pos - 1);
+    segment.placeholder = true;
+    if (text[end] == '}') {
+        return end + 1;
+    }
+    if (text[end] != '(') {
+        return std::string::npos;
+    }
+    segment.call = true;
+    ++end;
+    while (true) {
+        TemplateNode arg;
+        end = parseTemplateSegments(text, end, arg, true);
+        segment.args.push_back(std::move(arg));
+        if (end >= text.size()) {
+            return std::string::npos;
+        }
+        if (text[end] == ',') {
+            ++end;
+            continue;
+        }
+        // text[end] == ')'
+        if (end + 1 < text.size() && text[end + 1] == '}') {
+            compileTemplateJsonPath(segment);
+            return end + 2;
+        }
+        return std::string::npos;
+    }
+}
+
+TemplateNode parseTemplate(const std::string& text) {
+    TemplateNode node;
+    parseTemplateSegments(text, 0, node, false);
+    return node;
+}
+
+// Compiled templates are shared between the UI and the interpreter thread
+std::unordered_map<std::string, std::shared_ptr<const TemplateNode>> templateCache;
+Mutex templateCacheMutex;
+const size_t templateCacheLimit = 1024;
+
+std::shared_ptr<const TemplateNode> compileTemplate(const std::string& text) {
+    mutexLock(&templateCacheMutex);
+    auto it = templateCache.find(text);
+    if (it != templateCache.end()) {
+        auto node = it->second;
+        mutexUnlock(&templateCacheMutex);
+        return node;
+    }
+    mutexUnlock(&templateCacheMutex);
+
+    auto node = std::make_shared<const TemplateNode>(parseTemplate(text));
+
+    mutexLock(&templateCacheMutex);
+    if (templateCache.size() >= templateCacheLimit) {
+        templateCache.clear();
+    }
+    templateCache.emplace(text, node);
+    mutexUnlock(&templateCacheMutex);
+    return node;
+}
+
+// Integer arithmetic for {calc(...)}: + - * / % and parentheses, decimal or 0x-prefixed hex operands.
+// Like division by zero, a result that doesn't fit in a long long fails the calc.
+class TemplateCalc {
+public:
+    explicit TemplateCalc(const std::string& expr) : _expr(expr) {}
+
+    bool evaluate(long long& result) {
+        if (!parseSum(result)) {
+            return false;
+        }
+        skipSpaces();
+        return _pos == _expr.size();
+    }
+private:
+    void skipSpaces() {
+        while (_pos < _expr.size() && std::isspace(static_cast<unsigned char>(_expr[_pos]))) {
+            ++_pos;
+        }
+    }
+    bool parseSum(long long& result) {
+        if (!parseProduct(result)) {
+            return false;
+        }
+        while (true) {
+            skipSpaces();
+            if (_pos >= _expr.size() || (_expr[_pos] != '+' && _expr[_pos] != '-')) {
+                return true;
+            }
+            const char op = _expr[_pos++];
+            long long rhs;
+            if (!parseProduct(rhs)) {
+                return false;
+            }
+            if ((op == '+') ? __builtin_add_overflow(result, rhs, &result) : __builtin_sub_overflow(result, rhs, &result)) {
+                return false;
+            }
+        }
+    }
+    bool parseProduct(long long& result) {
+        if (!parseUnary(result)) {
+            return false;
+        }
+        while (true) {
+            skipSpaces();
+            if (_pos >= _expr.size() || (_expr[_pos] != '*' && _expr[_pos] != '/' && _expr[_pos] != '%')) {
+                return true;
+            }
+            const char op = _expr[_pos++];
+            long long rhs;
+            if (!parseUnary(rhs)) {
+                return false;
+            }
+            if (op == '*') {
+                if (__builtin_mul_overflow(result, rhs, &result)) {
+                    return false;
+                }
+            } else if (rhs == 0 || (rhs == -1 && result == LLONG_MIN)) {
+                return false;
+            } else {
+                result = (op == '/') ? result / rhs : result % rhs;
+            }
+        }
+    }
+    bool parseUnary(long long& result) {
+        skipSpaces();
+        if (_pos < _expr.size() && _expr[_pos] == '-') {
+            ++_pos;
+            if (!parseUnary(result)) {
+                return false;
+            }
+            return !__builtin_sub_overflow(0LL, result, &result);
+        }
+        if (_pos < _expr.size() && _expr[_pos] == '(') {
+            ++_pos;
+            if (!parseSum(result)) {
+                return false;
+            }
+            skipSpaces();
+            if (_pos >= _expr.size() || _expr[_pos] != ')') {
+                return false;
+            }
+            ++_pos;
+            return true;
+        }
+        int base = 10;
+        if (_expr.compare(_pos, 2, "0x") == 0 || _expr.compare(_pos, 2, "0X") == 0) {
+            base = 16;
+            _pos += 2;
+        }
+        const size_t start = _pos;
+        result = 0;
+        while (_pos < _expr.size() && std::isxdigit(static_cast<unsigned char>(_expr[_pos]))) {
+            const char c = _expr[_pos];
+            const int digit = std::isdigit(static_cast<unsigned char>(c)) ? c - '0' : std::tolower(c) - 'a' + 10;
+            if (digit >= base) {
+                break;
+            }
+            if (__builtin_mul_overflow(result, base, &result) || __builtin_add_overflow(result, digit, &result)) {
+                return false;
+            }
+            ++_pos;
+        }
+        return _pos > start;
+    }
+
+    const std::string& _expr;
+    size_t _pos = 0;
+};
+
+// Rendering
+bool renderTemplate(const TemplateNode& node, TemplateContext& context, std::string& out);
+
+bool resolveTemplateCall(const TemplateSegment& segment, const std::vector<std::string>& args, TemplateContext& context, std::string& out) {
+    const std::string& name = segment.text;
+    if (isJsonTemplateCall(name)) {
+        const bool isDataCall = name == "json_data";
+        if (!isDataCall && !context.hasSource) {
+            return false;
+        }
+        json_t* root = isDataCall ? context.jsonData.get() : context.jsonSource.get();
+        if (!root) {
+            return false;
+        }
+        if (segment.jsonPath) {
+            return getJsonValueByPath(root, *segment.jsonPath, context.source, out);
+        }
+        // The arguments held placeholders, compile them as rendered
+        return getJsonValueByPath(root, compileJsonPath(args, !isDataCall), context.source, out);
+    }
+    if (name == "calc" && args.size() == 1) {
+        long long result;
+        if (!TemplateCalc(args[0]).evaluate(result)) {
+            return false;
+        }
+        out = std::to_string(result);
+        return true;
+    }
+    return false;
+}
+
+bool resolveTemplateVariable(const std::string& name, TemplateContext& context, std::string& out) {
+    if (context.hasSource) {
+        if ((name == "source" && !context.toggle) || (name == "source_on" && context.on) || (name == "source_off" && !context.on)) {
+            out = context.source;
+            return true;
+        }
+        if (name == "name") {
+            out = context.name;
+            return true;
+        }
+        if (name == "parent_name") {
+            out = context.parentName;
+            return true;
+        }
+    }
+    auto it = context.variables.find(name);
+    if (it != context.variables.end()) {
+        out = it->second;
+        return true;
+    }
+    return false;
+}
+
+// Appends the rendered node to out, returns false if a placeholder was left unresolved
+bool renderTemplate(const TemplateNode& node, TemplateContext& context, std::string& out) {
+    bool complete = true;
+    std::string value;
+    for (const auto& segment : node.segments) {
+        if (!segment.placeholder) {
+            out += segment.text;
+            continue;
+        }
+        value.clear();
+        if (!segment.call) {
+            if (resolveTemplateVariable(segment.text, context, value)) {
+                out += value;
+            } else {
+                out += '{' + segment.text + '}';
+                complete = false;
+            }
+            continue;
+        }
+
+        std::vector<std::string> args(segment.args.size());
+        bool argsComplete = true;
+        for (size_t i = 0; i < segment.args.size(); ++i) {
+            argsComplete = renderTemplate(segment.args[i], context, args[i]) && argsComplete;
+        }
+        if (argsComplete && resolveTemplateCall(segment, args, context, value)) {
+            out += value;
+            continue;
+        }
+        // Keep the placeholder with whatever could be filled in for a later pass
+        out += '{' + segment.text + '(';
+        for (size_t i = 0; i < args.size(); ++i) {
+            if (i > 0) {
+                out += ',';
+            }
+            out += args[i];
+        }
+        out += ")}";
+        complete = false;
+    }
+    return complete;
+}
+
+std::string renderTemplate(const std::string& text, TemplateContext& context) {
+    if (text.find('{') == std::string::npos) {
+        return text;
+    }
+    std::string result;
+    result.reserve(text.size());
+    renderTemplate(*compileTemplate(text), context, result);
+    return result;
+}
+
+// Returns false if a placeholder was left unresolved, such as a calc dividing by zero
+bool renderCommand(std::vector<std::string>& command, TemplateContext& context) {
+    bool complete = true;
+    for (auto& arg : command) {
+        if (arg.find('{') != std::string::npos) {
+            std::string rendered;
+            rendered.reserve(arg.size());
+            complete = renderTemplate(*compileTemplate(arg), context, rendered) && complete;
+            arg = std::move(rendered);
+        }
+    }
+    return complete;
+}
+
+std::vector<std::vector<std::string>> getModifyCommands(const std::vector<std::vector<std::string>>& commands, const std::string& file, bool toggle = false, bool on = true, bool usingJsonSource = false) {
+    std::vector<std::vector<std::string>> modifiedCommands;
+    modifiedCommands.reserve(commands.size());
+
+    TemplateContext context;
+    context.setSource(file);
+    context.toggle = toggle;
+    context.on = on;
+
+    bool addCommands = false;
+    for (const auto& cmd : commands) {
+        if (cmd.size() > 1) {
+            if (toggle) {
+                if (cmd[0] == "source_on") {
+                    addCommands = on;
+                } else if (cmd[0] == "source_off") {
+                    addCommands = !on;
+                }
+            }
+            if ((usingJsonSource) && (cmd[0] == "json_source" || cmd[0] == "json_mark_cur_kip" || cmd[0] == "json_mark_cur_ini")) {
+                context.jsonSource.setPath(preprocessPath(cmd[1]));
+            }
+        }
+        if (!toggle or addCommands) {
+            modifiedCommands.push_back(cmd);
+            renderCommand(modifiedCommands.back(), context);
+        }
+    }
+    return modifiedCommands;
+}
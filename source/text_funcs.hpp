@@ -47,68 +47,76 @@ std::pair<std::string, int> readTextFromFile (const std::string& filePath) {
     return std::make_pair(lines, lineCount);
 }
 
-bool write_to_file(const std::string& file_path, const std::string& line) {
+// Text file kept in memory while add-txt-str / remove-txt-str edits are applied to it
+struct TextFileLines {
+  bool exists = false;
+  bool changed = false;
+  std::vector<std::string> lines;
+};
+
+TextFileLines readTextLines(const std::string& file_path) {
+  TextFileLines text;
   std::ifstream file(file_path);
   if (!file.is_open()) {
-    // File doesn't exist, create it
-    std::ofstream output_file(file_path);
-    if (!output_file.is_open()) {
-      log("Error opening file: %s", file_path.c_str());
-      return false;
-    }
-    output_file << line << std::endl;
-    return true;
+    return text;
   }
+  text.exists = true;
+  std::string line;
+  while (std::getline(file, line)) {
+    text.lines.push_back(std::move(line));
+  }
+  return text;
+}
 
-  std::string existing_line;
-  std::vector<std::string> existing_lines;
-  while (std::getline(file, existing_line)) {
-    existing_lines.push_back(existing_line);
+bool writeTextLines(const std::string& file_path, const TextFileLines& text) {
+  std::ofstream output_file(file_path);
+  if (!output_file.is_open()) {
+    return false;
   }
-  file.close();
+  for (const auto& line : text.lines) {
+    output_file << line << '\n';
+  }
+  return true;
+}
 
-  if (std::find(existing_lines.begin(), existing_lines.end(), line) != existing_lines.end()) {
-    return true; // Line already exists, no need to write it again
+// Appends the line unless it is already there; a missing file is created
+void addTextLine(TextFileLines& text, const std::string& line) {
+  if (text.exists && std::find(text.lines.begin(), text.lines.end(), line) != text.lines.end()) {
+    return; // Line already exists, no need to write it again
   }
+  text.exists = true;
+  text.lines.push_back(line);
+  text.changed = true;
+}
 
-  existing_lines.push_back(line);
+// Drops every line containing pattern
+void removeTextLines(TextFileLines& text, const std::string& pattern) {
+  const size_t size = text.lines.size();
+  text.lines.erase(std::remove_if(text.lines.begin(), text.lines.end(), [&pattern](const std::string& line) {
+    return line.find(pattern) != std::string::npos;
+  }), text.lines.end());
+  text.changed = text.changed || text.lines.size() != size;
+}
 
-  std::ofstream output_file(file_path);
-  if (!output_file.is_open()) {
+bool write_to_file(const std::string& file_path, const std::string& line) {
+  TextFileLines text = readTextLines(file_path);
+  addTextLine(text, line);
+  if (text.changed && !writeTextLines(file_path, text)) {
     log("Error opening file: %s", file_path.c_str());
     return false;
   }
-
-  for (const auto& existing_line : existing_lines) {
-    output_file << existing_line << std::endl;
-  }
   return true;
 }
 
 bool remove_txt(const std::string& file_path, const std::string& pattern) {
-  std::vector<std::string> lines;
-  std::ifstream file(file_path);
-  if (!file.is_open()) {
+  TextFileLines text = readTextLines(file_path);
+  if (!text.exists) {
     log("File %s not found", file_path.c_str());
     return true;
   }
-
-  std::string line;
-  while (std::getline(file, line)) {
-    if (line.find(pattern) == std::string::npos) {
-      lines.push_back(line);
-    }
-  }
-  file.close();
-
-  std::ofstream output_file(file_path);
-  if (!output_file.is_open()) {
+  removeTextLines(text, pattern);
+  if (text.changed && !writeTextLines(file_path, text)) {
     log("File %s can't be created", file_path.c_str());
-    return true;
-  }
-
-  for (const auto& line : lines) {
-    output_file << line << std::endl;
   }
   return true;
 }
\ No newline at end of file
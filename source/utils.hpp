@@ -4,12 +4,16 @@
 #include <dirent.h>
 #include <fnmatch.h>
 #include <get_funcs.hpp>
+#include <template_funcs.hpp>
 #include <path_funcs.hpp>
+#include <backup_funcs.hpp>
 #include <ini_funcs.hpp>
 #include <hex_funcs.hpp>
 #include <download_funcs.hpp>
 #include <json_funcs.hpp>
+#include <catalog_funcs.hpp>
 #include <text_funcs.hpp>
+#include <hash_funcs.hpp>
 #include <jansson.h>
 
 #define SpsmShutdownMode_Normal 0
@@ -50,6 +54,7 @@ const std::string overlayDirectory = "sdmc:/switch/.overlays/";
 const std::string teslaSettingsConfigIniPath = "sdmc:/config/tesla/"+configFileName;
 const std::string overlaysIniFilePath = settingsPath + "overlays.ini";
 const std::string packagesIniFilePath = settingsPath + "packages.ini";
+const std::string appliedIniFilePath = settingsPath + "applied.ini";
 const std::string checkmarkChar = "\uE14B";
 
 bool applied = false;
@@ -140,124 +145,440 @@ const std::vector<std::string> ultraProtectedFolders = {
     "sdmc:/Nintendo/",
     "sdmc:/emuMMC/"
 };
-bool isDangerousCombination(const std::string& patternPath) {
-    // List of obviously dangerous patterns
-    const std::vector<std::string> dangerousCombinationPatterns = {
-        "*",         // Deletes all files/directories in the current directory
-        "*/"         // Deletes all files/directories in the current directory
-    };
 
-    // List of obviously dangerous patterns
-    const std::vector<std::string> dangerousPatterns = {
-        "..",     // Attempts to traverse to parent directories
-        "~"       // Represents user's home directory, can be dangerous if misused
+// The folders above as a character trie, built once. A protected folder may not be targeted itself or with
+// a pattern of wildcards only, like "*", "*/" or "**", nothing inside an ultra protected folder may be targeted at all.
+struct ProtectedPathTrie {
+    struct Node {
+        std::map<char, size_t> children;
+        bool isProtected = false;
+        bool isUltraProtected = false;
     };
+    std::vector<Node> nodes;
 
-    // Check if the patternPath is an ultra protected folder
-    for (const std::string& ultraProtectedFolder : ultraProtectedFolders) {
-        if (patternPath.starts_with(ultraProtectedFolder)) {
-            return true; // Pattern path is an ultra protected folder
+    ProtectedPathTrie() : nodes(1) {
+        for (const auto& folder : protectedFolders) {
+            nodes[insert(folder)].isProtected = true;
+        }
+        for (const auto& folder : ultraProtectedFolders) {
+            nodes[insert(folder)].isUltraProtected = true;
         }
     }
 
-    // Check if the patternPath is a protected folder
-    for (const std::string& protectedFolder : protectedFolders) {
-        if (patternPath == protectedFolder) {
-            return true; // Pattern path is a protected folder
+    size_t insert(const std::string& path) {
+        size_t node = 0;
+        for (char c : path) {
+            auto it = nodes[node].children.find(c);
+            if (it == nodes[node].children.end()) {
+                nodes.emplace_back();
+                it = nodes[node].children.emplace(c, nodes.size() - 1).first;
+            }
+            node = it->second;
         }
+        return node;
+    }
 
-        // Check if the patternPath starts with a protected folder and includes a dangerous pattern
-        if (patternPath.starts_with(protectedFolder)) {
-            std::string relativePath = patternPath.substr(protectedFolder.size());
-
-            // Split the relativePath by '/' to handle multiple levels of wildcards
-            std::vector<std::string> pathSegments;
-            std::string pathSegment;
+    // Wildcards only, over one level or over any number of them with "**"
+    static bool isCatchAll(std::string_view rest) {
+        if (rest.find_first_not_of("*?[]{},!^-/") != std::string_view::npos) {
+            return false;
+        }
+        if (!rest.empty() && rest.back() == '/') {
+            rest.remove_suffix(1);
+        }
+        return rest.find('/') == std::string_view::npos || rest.find("**") != std::string_view::npos;
+    }
 
-            for (char c : relativePath) {
-                if (c == '/') {
-                    if (!pathSegment.empty()) {
-                        pathSegments.push_back(pathSegment);
-                        pathSegment.clear();
-                    }
-                } else {
-                    pathSegment += c;
+    bool isProtectedTarget(const std::string& path) const {
+        size_t node = 0;
+        for (size_t i = 0;; ++i) {
+            if (nodes[node].isUltraProtected) {
+                return true;
+            }
+            if (nodes[node].isProtected) {
+                const std::string_view rest = std::string_view(path).substr(i);
+                if (rest.empty() || isCatchAll(rest)) {
+                    return true;
                 }
             }
-
-            if (!pathSegment.empty()) {
-                pathSegments.push_back(pathSegment);
+            if (i == path.size()) {
+                return false;
+            }
+            auto it = nodes[node].children.find(path[i]);
+            if (it == nodes[node].children.end()) {
+                return false;
             }
+            node = it->second;
+        }
+    }
+};
 
-            for (const std::string& pathSegment : pathSegments) {
-                // Check if the pathSegment includes a dangerous pattern
-                for (const std::string& dangerousPattern : dangerousPatterns) {
-                    if (pathSegment.find(dangerousPattern) != std::string::npos) {
-                        return true; // Pattern path includes a dangerous pattern
-                    }
-                }
+bool isDangerousCombination(const std::string& patternPath) {
+    static const ProtectedPathTrie protectedPaths;
+
+    // Attempts to traverse to parent directories or the user's home directory
+    if (patternPath.find("..") != std::string::npos || patternPath.find('~') != std::string::npos) {
+        return true;
+    }
+
+    // Pattern path is a protected folder, possibly combined with a wildcard, or inside an ultra protected one
+    if (protectedPaths.isProtectedTarget(patternPath)) {
+        return true;
+    }
+
+    // Check if the patternPath includes a wildcard at the root level
+    const size_t rootEnd = patternPath.find(":/");
+    if (rootEnd != std::string::npos && patternPath.find_first_of("*?[{") < rootEnd + 2) {
+        return true;
+    }
+
+    return false; // Pattern path is not a protected folder, a dangerous pattern, or includes a wildcard at the root level
+}
+
+// Commands that leave the same state behind when they are run again
+const std::vector<std::string> idempotentCommands = {
+    "catch_errors", "ignore_errors", "skip_applied", "verify", "no_verify", "json_data", "set", "make", "mkdir", "copy", "cp",
+    "set-ini-val", "set-ini-value", "set-ini-key", "remove-ini-key", "remove-txt-str", "add-txt-str",
+    "hex-by-offset", "hex-by-swap", "hex-by-string", "hex-by-decimal", "hex-by-rdecimal",
+    "hex-by-cust-offset-dec", "hex-by-cust-offset"
+};
+
+// Fingerprint of an option run in skip_applied mode: optionKey identifies the commands as they are run, with
+// their placeholders filled in, stateHash also covers the content of every file they touch.
+// Returns false if the option can't be skipped as a whole.
+bool getAppliedFingerprint(const std::vector<std::vector<std::string>>& commands, std::string& optionKey, std::string& stateHash) {
+    bool skipApplied = false;
+    uint64_t commandsHash = fnv1aOffsetBasis;
+    std::vector<std::string> paths;
+    TemplateContext context;
+
+    for (const auto& unmodifiedCommand : commands) {
+        if (unmodifiedCommand.empty()) {
+            continue;
+        }
+        std::vector<std::string> command = unmodifiedCommand;
+        if (!renderCommand(command, context)) {
+            return false;
+        }
+        if (command[0] == "skip_applied") {
+            skipApplied = true;
+        } else if (std::find(idempotentCommands.begin(), idempotentCommands.end(), command[0]) == idempotentCommands.end()) {
+            return false;
+        } else if (command[0] == "set" && command.size() >= 3) {
+            context.variables[command[1]] = command[2];
+        } else if (command[0] == "json_data" && command.size() >= 2) {
+            context.jsonData.setPath(preprocessPath(command[1]));
+        }
+        for (const auto& arg : command) {
+            commandsHash = fnv1aHash(arg, commandsHash);
+            commandsHash = fnv1aHash("\n", 1, commandsHash);
+        }
+        for (size_t i = 1; i < command.size(); ++i) {
+            const std::string arg = removeQuotes(command[i]);
+            if (arg.empty() || (arg[0] != '/' && !startsWith(arg, "sdmc:"))) {
+                continue;
+            }
+            if (isGlobPattern(arg)) {
+                return false;
+            }
+            paths.push_back(preprocessPath(arg));
+        }
+        if ((command[0] == "copy" || command[0] == "cp") && command.size() >= 3) {
+            // Whole trees are left to the per-file checks
+            if (isDirectory(preprocessPath(command[1]))) {
+                return false;
+            }
+            const std::string destinationPath = preprocessPath(command[2]);
+            if (destinationPath.back() == '/') {
+                paths.push_back(destinationPath + getNameFromPath(preprocessPath(command[1])));
             }
         }
+    }
+    if (!skipApplied) {
+        return false;
+    }
 
-        // Check if the patternPath is a combination of a protected folder and a dangerous pattern
-        for (const std::string& dangerousPattern : dangerousCombinationPatterns) {
-            if (patternPath == protectedFolder + dangerousPattern) {
-                return true; // Pattern path is a protected folder combined with a dangerous pattern
+    uint64_t state = commandsHash;
+    for (const auto& path : paths) {
+        struct stat pathStat;
+        uint64_t contentHash = 0;
+        if (stat(path.c_str(), &pathStat) == 0) {
+            // Content rather than mtimes: FAT mtimes can't tell apart changes made within the same 2 seconds
+            if (S_ISREG(pathStat.st_mode) && !getContentHash(path, pathStat, contentHash)) {
+                return false;
             }
+            const long long values[] = {static_cast<long long>(pathStat.st_mode), static_cast<long long>(pathStat.st_size), static_cast<long long>(contentHash)};
+            state = fnv1aHash(values, sizeof(values), state);
+        } else {
+            state = fnv1aHash("-", 1, state);
         }
     }
+    optionKey = hashToHex(commandsHash);
+    stateHash = hashToHex(state);
+    return true;
+}
 
-    // Check if the patternPath is a dangerous pattern
-    if (patternPath.starts_with("sdmc:/")) {
-        std::string relativePath = patternPath.substr(6); // Remove "sdmc:/"
+// Fingerprints of the options run last, the oldest are dropped beyond the limit
+const size_t appliedFingerprintLimit = 64;
+
+void saveAppliedFingerprint(const std::string& optionKey, const std::string& stateHash) {
+    std::vector<std::string> lines, entries;
+    readIniLines(appliedIniFilePath, lines);
+    bool inSection = false;
+    for (const auto& line : lines) {
+        const std::string trimmed = trim(line);
+        if (!trimmed.empty() && trimmed[0] == '[') {
+            inSection = trimmed == "[applied]";
+        } else if (inSection && trimmed.find('=') != std::string::npos && trim(trimmed.substr(0, trimmed.find('='))) != optionKey) {
+            entries.push_back(trimmed);
+        }
+    }
+    entries.push_back(optionKey + "=" + stateHash);
+    if (entries.size() > appliedFingerprintLimit) {
+        entries.erase(entries.begin(), entries.end() - appliedFingerprintLimit);
+    }
+    entries.insert(entries.begin(), "[applied]");
+    writeIniLines(appliedIniFilePath, entries);
+}
 
-        // Split the relativePath by '/' to handle multiple levels of wildcards
-        std::vector<std::string> pathSegments;
-        std::string pathSegment;
+// Edits that can share one open/modify/write cycle when consecutive commands target the same file
+enum class EditKind {
+    None,
+    Hex,        // hex-by-offset, hex-by-cust-offset, hex-by-cust-offset-dec
+    IniLine,    // set-ini-val, set-ini-key
+    IniRemove,  // remove-ini-key
+    IniData,    // set-ini-val, remove-ini-key with {section {key, value}} data
+    Text        // add-txt-str, remove-txt-str
+};
 
-        for (char c : relativePath) {
-            if (c == '/') {
-                if (!pathSegment.empty()) {
-                    pathSegments.push_back(pathSegment);
-                    pathSegment.clear();
-                }
-            } else {
-                pathSegment += c;
-            }
+EditKind getEditKind(const std::vector<std::string>& command) {
+    const std::string& name = command[0];
+    if ((name == "hex-by-offset" || name == "hex-by-cust-offset" || name == "hex-by-cust-offset-dec") && command.size() >= 4) {
+        return EditKind::Hex;
+    } else if (name == "set-ini-val" || name == "set-ini-value") {
+        if (command.size() == 3) {
+            return EditKind::IniData;
+        } else if (command.size() >= 5) {
+            return EditKind::IniLine;
         }
+    } else if (name == "set-ini-key" && command.size() >= 5) {
+        return EditKind::IniLine;
+    } else if (name == "remove-ini-key") {
+        if (command.size() == 3) {
+            return EditKind::IniData;
+        } else if (command.size() >= 4) {
+            return EditKind::IniRemove;
+        }
+    } else if ((name == "add-txt-str" || name == "remove-txt-str") && command.size() == 3) {
+        return EditKind::Text;
+    }
+    return EditKind::None;
+}
 
-        if (!pathSegment.empty()) {
-            pathSegments.push_back(pathSegment);
+// Joins the arguments from index first on, as the INI value commands do
+std::string joinCommandArgs(const std::vector<std::string>& command, size_t first) {
+    std::string result;
+    for (size_t i = first; i < command.size(); ++i) {
+        result += command[i];
+        if (i < command.size() - 1) {
+            result += " ";
         }
+    }
+    return result;
+}
 
-        for (const std::string& pathSegment : pathSegments) {
-            // Check if the pathSegment includes a dangerous pattern
-            for (const std::string& dangerousPattern : dangerousPatterns) {
-                if (pathSegment == dangerousPattern) {
-                    return true; // Pattern path is a dangerous pattern
+// Runs consecutive edits of one kind on the same file with a single read and write, one result per command.
+// With stopOnError the edits after the first failure aren't applied.
+std::vector<bool> runEditBatch(EditKind kind, const std::vector<std::vector<std::string>>& batch, bool stopOnError, bool skipApplied) {
+    const std::string filePath = preprocessPath(batch[0][1]);
+    std::vector<bool> results(batch.size(), true);
+
+    if (kind == EditKind::Hex) {
+        std::vector<HexEdit> edits;
+        std::vector<size_t> editCommands; // Index in batch of each edit
+        edits.reserve(batch.size());
+        for (size_t i = 0; i < batch.size(); ++i) {
+            const auto& command = batch[i];
+            size_t offset;
+            if (!parseOffset(removeQuotes(command[2]), offset)) {
+                log("Invalid offset \"%s\"", command[2].c_str());
+                results[i] = false;
+                if (stopOnError) {
+                    break;
                 }
+                continue;
+            }
+            if (command[0] == "hex-by-cust-offset-dec") {
+                edits.push_back({offset, decimalToReversedHex(removeQuotes(command[3])), true});
+            } else {
+                edits.push_back({offset, removeQuotes(command[3]), command[0] == "hex-by-cust-offset"});
+            }
+            editCommands.push_back(i);
+        }
+        const std::vector<bool> editResults = hexEditBatch(filePath, edits, stopOnError);
+        for (size_t i = 0; i < editResults.size(); ++i) {
+            results[editCommands[i]] = editResults[i];
+        }
+        return results;
+    } else if (kind == EditKind::IniLine) {
+        std::vector<std::string> lines;
+        bool exists = readIniLines(filePath, lines);
+        bool changed = false;
+        for (const auto& command : batch) {
+            const std::string section = removeQuotes(command[2]);
+            const std::string key = removeQuotes(command[3]);
+            const std::string value = joinCommandArgs(command, 4);
+            if (command[0] == "set-ini-key") {
+                setIniLines(lines, exists, section, key, "", value);
+                changed = true;
+            } else if (!(skipApplied && exists && !value.empty() && readIniLinesValue(lines, section, key) == trim(removeQuotes(value)))) {
+                setIniLines(lines, exists, section, key, value, "");
+                changed = true;
+            }
+        }
+        if (changed || !skipApplied) {
+            cleanIniLines(lines);
+            if (!writeIniLines(filePath, lines)) {
+                results.assign(batch.size(), false);
+            }
+        }
+    } else if (kind == EditKind::IniRemove) {
+        std::vector<std::string> lines;
+        bool removed = false;
+        if (readIniLines(filePath, lines)) {
+            for (const auto& command : batch) {
+                removed = removeIniLines(lines, removeQuotes(command[2]), removeQuotes(command[3])) || removed;
+            }
+        }
+        // A missing file isn't created, and a file without the keys is left as it is
+        if (removed && !writeIniLines(filePath, lines)) {
+            results.assign(batch.size(), false);
+        }
+    } else if (kind == EditKind::IniData) {
+        IniSectionInput iniData = readIniFile(filePath);
+        bool changed = false;
+        for (const auto& command : batch) {
+            changed = updateIniData(iniData, parseDesiredData(command[2]), command[0] == "remove-ini-key") || changed;
+        }
+        if (changed || !skipApplied) {
+            writeIniFile(filePath, iniData);
+        }
+    } else if (kind == EditKind::Text) {
+        TextFileLines text = readTextLines(filePath);
+        for (const auto& command : batch) {
+            if (command[0] == "add-txt-str") {
+                addTextLine(text, removeQuotes(command[2]));
+            } else if (text.exists) {
+                removeTextLines(text, removeQuotes(command[2]));
+            } else {
+                log("File %s not found", filePath.c_str());
+            }
+        }
+        if (text.changed && !writeTextLines(filePath, text)) {
+            log("Error opening file: %s", filePath.c_str());
+            for (size_t i = 0; i < batch.size(); ++i) {
+                results[i] = (batch[i][0] != "add-txt-str");
             }
         }
     }
+    return results;
+}
 
-    // Check if the patternPath includes a wildcard at the root level
-    if (patternPath.find(":/") != std::string::npos) {
-        std::string rootPath = patternPath.substr(0, patternPath.find(":/") + 2);
-        if (rootPath.find('*') != std::string::npos) {
-            return true; // Pattern path includes a wildcard at the root level
+// Block structure of an option. For every if/else/endif/for/endfor the interpreter jumps to jumps[index]
+// and continues with the command after it, so blocks are matched once instead of searched at runtime.
+struct ControlFlow {
+    bool valid = true;
+    std::vector<size_t> jumps;
+};
+
+ControlFlow compileControlFlow(const std::vector<std::vector<std::string>>& commands) {
+    ControlFlow flow;
+    flow.jumps.assign(commands.size(), 0);
+    std::vector<size_t> openBlocks;
+    for (size_t i = 0; i < commands.size() && flow.valid; ++i) {
+        if (commands[i].empty()) {
+            continue;
         }
+        const std::string& name = commands[i][0];
+        const std::string openName = openBlocks.empty() ? "" : commands[openBlocks.back()][0];
+        if (name == "if" || name == "for") {
+            openBlocks.push_back(i);
+        } else if (name == "else" && openName == "if") {
+            // A false condition continues in the else branch
+            flow.jumps[openBlocks.back()] = i;
+            openBlocks.back() = i;
+        } else if (name == "endif" && (openName == "if" || openName == "else")) {
+            flow.jumps[openBlocks.back()] = i;
+            openBlocks.pop_back();
+        } else if (name == "endfor" && openName == "for") {
+            flow.jumps[openBlocks.back()] = i;
+            flow.jumps[i] = openBlocks.back();
+            openBlocks.pop_back();
+        } else if (name == "else" || name == "endif" || name == "endfor") {
+            log("Error in %s command: no matching block", name.c_str());
+            flow.valid = false;
+        }
+    }
+    if (flow.valid && !openBlocks.empty()) {
+        log("Error in %s command: block is not closed", commands[openBlocks.back()][0].c_str());
+        flow.valid = false;
     }
+    return flow;
+}
 
-    // Check if the provided path matches any dangerous patterns
-    for (const std::string& pattern : dangerousPatterns) {
-        if (patternPath.find(pattern) != std::string::npos) {
-            return true; // Path contains a dangerous pattern
-        }
+// Evaluates the condition of "if [not] file_exists <path>", "if [not] ini_eq <file> <section> <key> <value>"
+// and "if hw ==|!= mariko|erista". Returns false if the condition can't be parsed.
+bool evaluateCondition(const std::vector<std::string>& command, bool& result) {
+    size_t first = 1;
+    bool negate = false;
+    if (command.size() > first && command[first] == "not") {
+        negate = true;
+        ++first;
+    }
+    if (command.size() <= first) {
+        return false;
     }
 
-    return false; // Pattern path is not a protected folder, a dangerous pattern, or includes a wildcard at the root level
+    const std::string& condition = command[first];
+    if (condition == "file_exists" && command.size() == first + 2) {
+        const std::string path = preprocessPath(command[first + 1]);
+        if (isGlobPattern(path)) {
+            // The first match settles it
+            result = false;
+            forEachGlobMatch(path, [&](const std::string&) {
+                result = true;
+                return false;
+            });
+        } else {
+            result = isFileOrDirectory(path);
+        }
+    } else if (condition == "ini_eq" && command.size() >= first + 5) {
+        const std::string value = joinCommandArgs(command, first + 4);
+        result = readIniValue(preprocessPath(command[first + 1]), removeQuotes(command[first + 2]), removeQuotes(command[first + 3])) == trim(removeQuotes(value));
+    } else if (condition == "hw" && command.size() == first + 3 && (command[first + 1] == "==" || command[first + 1] == "!=")) {
+        const std::string hardware = removeQuotes(command[first + 2]);
+        if (hardware != "mariko" && hardware != "erista") {
+            return false;
+        }
+        static const bool isMariko = isMarikoHWType();
+        result = (isMariko == (hardware == "mariko")) == (command[first + 1] == "==");
+    } else {
+        return false;
+    }
+    if (negate) {
+        result = !result;
+    }
+    return true;
 }
 
+// State of a running for loop
+struct LoopFrame {
+    size_t forIndex;
+    std::string variable;
+    std::vector<std::string> items;
+    size_t position;
+};
+
 struct ThreadArgs {
     bool* exitMT;
     std::vector<std::vector<std::string>> commands;
@@ -272,40 +593,80 @@ int interpretAndExecuteCommand(const std::vector<std::vector<std::string>>& comm
                                tsl::elm::ListItem* listItem = nullptr) {
     std::string commandName, jsonPath, sourcePath, destinationPath, desiredSection, desiredKey, desiredNewKey, desiredValue, offset, hexDataToReplace, hexDataReplacement, fileUrl, occurrence;
     bool catchErrors = false;
+    bool skipApplied = false;
+    bool verifyCopies = false;
     int curProgress = 0;
-    for (auto& unmodifiedCommand : commands) {
-            
+    TemplateContext context;
+
+    std::string optionKey, stateHash;
+    const bool fingerprinted = getAppliedFingerprint(commands, optionKey, stateHash);
+    if (fingerprinted && readIniValue(appliedIniFilePath, "applied", optionKey) == stateHash) {
+        // Same commands on untouched files, everything is already in place
+        return 0;
+    }
+
+    const ControlFlow flow = compileControlFlow(commands);
+    if (!flow.valid) {
+        return -1;
+    }
+    std::vector<LoopFrame> loops;
+
+    for (size_t commandIndex = 0; commandIndex < commands.size(); ++commandIndex) {
+        const auto& unmodifiedCommand = commands[commandIndex];
+
         // Check the command and perform the appropriate action
         if (unmodifiedCommand.empty()) {
             // Empty command, do nothing
             continue;
         }
 
+        // The previous command may have changed the SD card
+        clearDirectoryCache();
+
         // Get the command name (first part of the command)
         commandName = unmodifiedCommand[0];
         //log(commandName);
         //log(command[1]);
         
         
-        std::vector<std::string> command;
-        
-        // Modify the command to replace {json_data} placeholder if jsonPath is available
-        if (!jsonPath.empty()) {
-            std::vector<std::string> modifiedCommand;
-            for (const std::string& commandArg : unmodifiedCommand) {
-                if (commandArg.find("{json_data(") != std::string::npos) {
-                    // Create a copy of the string and modify it
-                    std::string modifiedArg = commandArg;
-                    modifiedArg = replaceJsonSourcePlaceholder(modifiedArg, jsonPath);
-                    // Use modifiedArg as needed
-                    modifiedCommand.push_back(modifiedArg);
-                } else {
-                    modifiedCommand.push_back(commandArg);
+        // Fill in {json_data(...)}, {calc(...)} and user variables
+        std::vector<std::string> command = unmodifiedCommand;
+        if (!renderCommand(command, context)) {
+            // A command with a placeholder left in it would act on the placeholder's text
+            log("Unresolved placeholder in %s command", commandName.c_str());
+            if (catchErrors || commandName == "if" || commandName == "for") {
+                return -1;
+            }
+            continue;
+        }
+
+        // Consecutive edits of the same file share one open/modify/write cycle
+        size_t foldedCommands = 1;
+        const EditKind editKind = getEditKind(command);
+        if (editKind != EditKind::None) {
+            std::vector<std::vector<std::string>> batch = {command};
+            const std::string targetPath = preprocessPath(command[1]);
+            while (commandIndex + batch.size() < commands.size()) {
+                std::vector<std::string> nextCommand = commands[commandIndex + batch.size()];
+                if (nextCommand.empty()) {
+                    break;
+                }
+                if (!renderCommand(nextCommand, context) || getEditKind(nextCommand) != editKind || preprocessPath(nextCommand[1]) != targetPath) {
+                    break;
                 }
+                batch.push_back(std::move(nextCommand));
+            }
+            if (batch.size() > 1) {
+                const std::vector<bool> results = runEditBatch(editKind, batch, catchErrors, skipApplied);
+                for (size_t i = 0; i < results.size(); ++i) {
+                    if (!results[i] && catchErrors) {
+                        log("Error in %s command", batch[i][0].c_str());
+                        return -1;
+                    }
+                }
+                foldedCommands = batch.size();
+                commandIndex += foldedCommands - 1;
             }
-            command = modifiedCommand;
-        } else {
-            command = unmodifiedCommand;
         }
         
         // if (commandName == "json-set-current") {
@@ -314,15 +675,78 @@ int interpretAndExecuteCommand(const std::vector<std::vector<std::string>>& comm
         //         offset = removeQuotes(command[2]);
         //         editJSONfile(jsonPath.c_str(), offset);
         //     }
-        if (commandName == "catch_errors") {
+        if (foldedCommands > 1) {
+            // Done as part of the batch above
+        } else if (commandName == "if") {
+            bool conditionMet = false;
+            if (!evaluateCondition(command, conditionMet)) {
+                log("Error in %s command: unknown condition", commandName.c_str());
+                return -1;
+            }
+            if (!conditionMet) {
+                commandIndex = flow.jumps[commandIndex];
+            }
+        } else if (commandName == "else") {
+            // End of the taken branch
+            commandIndex = flow.jumps[commandIndex];
+        } else if (commandName == "endif") {
+            // Nothing to do, the block ends here
+        } else if (commandName == "for") {
+            // for <variable> in <pattern>
+            if (command.size() != 4 || command[2] != "in") {
+                log("Error in %s command: expected \"for <variable> in <pattern>\"", commandName.c_str());
+                return -1;
+            }
+            LoopFrame loop{commandIndex, command[1], {}, 0};
+            sourcePath = preprocessPath(command[3]);
+            if (isGlobPattern(sourcePath)) {
+                loop.items = getFilesListByWildcards(sourcePath);
+            } else if (isFileOrDirectory(sourcePath)) {
+                loop.items.push_back(sourcePath);
+            }
+            // Paths are handed to the body without the sdmc: prefix, as they are written in packages
+            for (auto& item : loop.items) {
+                if (item.compare(0, 5, "sdmc:") == 0) {
+                    item.erase(0, 5);
+                }
+            }
+            if (loop.items.empty()) {
+                commandIndex = flow.jumps[commandIndex];
+            } else {
+                context.variables[loop.variable] = loop.items[0];
+                loops.push_back(std::move(loop));
+            }
+        } else if (commandName == "endfor") {
+            LoopFrame& loop = loops.back();
+            if (++loop.position < loop.items.size()) {
+                context.variables[loop.variable] = loop.items[loop.position];
+                commandIndex = loop.forIndex;
+            } else {
+                loops.pop_back();
+            }
+        } else if (commandName == "catch_errors") {
             catchErrors = true;
         } else if (commandName == "ignore_errors") {
             catchErrors = false;
+        } else if (commandName == "skip_applied") {
+            skipApplied = true;
+        } else if (commandName == "always_apply") {
+            skipApplied = false;
+        } else if (commandName == "verify") {
+            verifyCopies = true;
+        } else if (commandName == "no_verify") {
+            verifyCopies = false;
         } else if (commandName == "back") {
             return 1;
         } else if (commandName == "json_data") {
             if (command.size() >= 2) {
                 jsonPath = preprocessPath(command[1]);
+                context.jsonData.setPath(jsonPath);
+            }
+        } else if (commandName == "set") {
+            // User variable, available as {name} to the commands that follow
+            if (command.size() >= 3) {
+                context.variables[command[1]] = command[2];
             }
         } else if (commandName == "make" || commandName == "mkdir") {
             // Make direcrory command
@@ -342,11 +766,11 @@ int interpretAndExecuteCommand(const std::vector<std::vector<std::string>>& comm
                     sourcePath = preprocessPath(command[1]);
                     destinationPath = preprocessPath(command[2]);
                     bool result;
-                    if (sourcePath.find('*') != std::string::npos) {
+                    if (isGlobPattern(sourcePath)) {
                     // Copy files or directories by pattern
-                    result = copyFileOrDirectoryByPattern(sourcePath, destinationPath);
+                    result = copyFileOrDirectoryByPattern(sourcePath, destinationPath, skipApplied, verifyCopies);
                     } else {
-                        result = copyFileOrDirectory(sourcePath, destinationPath);
+                        result = copyFileOrDirectory(sourcePath, destinationPath, skipApplied, verifyCopies);
                     }
                     if (!result && catchErrors) {
                         log("Error in %s command", commandName.c_str());
@@ -363,9 +787,9 @@ int interpretAndExecuteCommand(const std::vector<std::vector<std::string>>& comm
                 sourcePath = preprocessPath(command[1]);
                 if (command.size() >= 3) {
                     destinationPath = preprocessPath(command[2]);
-                    result = mirrorCopyFiles(sourcePath, destinationPath);
+                    result = mirrorCopyFiles(sourcePath, destinationPath, skipApplied, verifyCopies);
                 } else {
-                    result = mirrorCopyFiles(sourcePath);
+                    result = mirrorCopyFiles(sourcePath, "sdmc:/", skipApplied, verifyCopies);
                 }
                 if (!result && catchErrors) {
                     log("Error in %s command", commandName.c_str());
@@ -379,9 +803,9 @@ int interpretAndExecuteCommand(const std::vector<std::vector<std::string>>& comm
                 if (command[1] != "") {
                 sourcePath = preprocessPath(command[1]);
                     if (!isDangerousCombination(sourcePath)) {
-                        if (sourcePath.find('*') != std::string::npos) {
+                        if (isGlobPattern(sourcePath)) {
                             // Delete files or directories by pattern
-                            result = deleteFileOrDirectoryByPattern(sourcePath);
+                            result = deleteFileOrDirectoryByPattern(sourcePath, progress.empty() ? nullptr : listItem, commands.size(), curProgress);
                         } else {
                             result = deleteFileOrDirectory(sourcePath);
                         }
@@ -418,12 +842,12 @@ int interpretAndExecuteCommand(const std::vector<std::vector<std::string>>& comm
                 //log("destinationPath: "+destinationPath);
                 
                 if (!isDangerousCombination(sourcePath)) {
-                    if (sourcePath.find('*') != std::string::npos) {
+                    if (isGlobPattern(sourcePath)) {
                         // Move files by pattern
-                        result = moveFilesOrDirectoriesByPattern(sourcePath, destinationPath);
+                        result = moveFilesOrDirectoriesByPattern(sourcePath, destinationPath, verifyCopies);
                     } else {
                         // Move single file or directory
-                        result = moveFileOrDirectory(sourcePath, destinationPath);
+                        result = moveFileOrDirectory(sourcePath, destinationPath, verifyCopies);
                     }
                     if (!result && catchErrors) {
                         log("Error in %s command", commandName.c_str());
@@ -445,8 +869,9 @@ int interpretAndExecuteCommand(const std::vector<std::vector<std::string>>& comm
                 // log(command[2]);
                 IniSectionInput iniData = readIniFile(sourcePath);
                 IniSectionInput desiredData = parseDesiredData(command[2]);
-                updateIniData(iniData, desiredData);
-                writeIniFile(sourcePath, iniData);
+                if (updateIniData(iniData, desiredData) || !skipApplied) {
+                    writeIniFile(sourcePath, iniData);
+                }
 
             } else if (command.size() >= 5) {
                 desiredValue = "";
@@ -462,7 +887,8 @@ int interpretAndExecuteCommand(const std::vector<std::vector<std::string>>& comm
                     }
                 }
 
-                bool result = setIniFileValue(sourcePath, desiredSection, desiredKey, desiredValue);
+                const bool alreadySet = skipApplied && !desiredValue.empty() && readIniValue(sourcePath, desiredSection, desiredKey) == trim(removeQuotes(desiredValue));
+                bool result = alreadySet || setIniFileValue(sourcePath, desiredSection, desiredKey, desiredValue);
                 if (!result && catchErrors) {
                     log("Error in %s command", commandName.c_str());
                     return -1;
@@ -476,6 +902,7 @@ int interpretAndExecuteCommand(const std::vector<std::vector<std::string>>& comm
                 desiredSection = removeQuotes(command[2]);
                 desiredKey = removeQuotes(command[3]);
 
+                desiredNewKey = "";
                 for (size_t i = 4; i < command.size(); ++i) {
                     desiredNewKey += command[i];
                     if (i < command.size() - 1) {
@@ -496,8 +923,9 @@ int interpretAndExecuteCommand(const std::vector<std::vector<std::string>>& comm
                 // log(command[2]);
                 IniSectionInput iniData = readIniFile(sourcePath);
                 IniSectionInput desiredData = parseDesiredData(command[2]);
-                updateIniData(iniData, desiredData, true);
-                writeIniFile(sourcePath, iniData);
+                if (updateIniData(iniData, desiredData, true) || !skipApplied) {
+                    writeIniFile(sourcePath, iniData);
+                }
 
             } else if (command.size() >= 4) {
                 sourcePath = preprocessPath(command[1]);
@@ -541,7 +969,8 @@ int interpretAndExecuteCommand(const std::vector<std::vector<std::string>>& comm
                 offset = removeQuotes(command[2]);
                 hexDataReplacement = removeQuotes(command[3]);
 
-                bool result = hexEditByOffset(sourcePath, std::stoul(offset), hexDataReplacement);
+                size_t offsetValue;
+                bool result = parseOffset(offset, offsetValue) && hexEditByOffset(sourcePath, offsetValue, hexDataReplacement);
                 if (!result && catchErrors) {
                     log("Error in %s command", commandName.c_str());
                     return -1;
@@ -644,7 +1073,8 @@ int interpretAndExecuteCommand(const std::vector<std::vector<std::string>>& comm
                 sourcePath = preprocessPath(command[1]);
                 offset = removeQuotes(command[2]);
                 hexDataReplacement = decimalToReversedHex(removeQuotes(command[3]));
-                bool result = hexEditCustOffset(sourcePath, std::stoul(offset), hexDataReplacement);
+                size_t offsetValue;
+                bool result = parseOffset(offset, offsetValue) && hexEditCustOffset(sourcePath, offsetValue, hexDataReplacement);
                 if (!result && catchErrors) {
                     log("Error in %s command", commandName.c_str());
                     return -1;
@@ -656,7 +1086,8 @@ int interpretAndExecuteCommand(const std::vector<std::vector<std::string>>& comm
                 sourcePath = preprocessPath(command[1]);
                 offset = removeQuotes(command[2]);
                 hexDataReplacement = removeQuotes(command[3]);
-                bool result = hexEditCustOffset(sourcePath, std::stoul(offset), hexDataReplacement);
+                size_t offsetValue;
+                bool result = parseOffset(offset, offsetValue) && hexEditCustOffset(sourcePath, offsetValue, hexDataReplacement);
                 if (!result && catchErrors) {
                     log("Error in %s command", commandName.c_str());
                     return -1;
@@ -669,6 +1100,8 @@ int interpretAndExecuteCommand(const std::vector<std::vector<std::string>>& comm
                 destinationPath = preprocessPath(command[2]);
                 //log("fileUrl: "+fileUrl);
                 bool result = downloadFile(fileUrl, destinationPath, listItem, commands.size(), curProgress);
+                // The json_data document may have just been replaced
+                context.jsonData.reload();
                 if (!result && catchErrors) {
                     log("Error in %s command", commandName.c_str());
                     return -1;
@@ -696,16 +1129,29 @@ int interpretAndExecuteCommand(const std::vector<std::vector<std::string>>& comm
             fsdevUnmountAll();
             spsmShutdown(SpsmShutdownMode_Normal);
         } else if (commandName == "backup") {
-            // Generate backup
-            generateBackup();
+            // Generate backup, optionally keeping only the newest ones
+            int keep = 0;
+            if (command.size() >= 2) {
+                keep = std::atoi(removeQuotes(command[1]).c_str());
+            }
+            if (!generateBackup(keep) && catchErrors) {
+                log("Error in %s command", commandName.c_str());
+                return -1;
+            }
         }
         if (!progress.empty()) {
-            curProgress += 100/commands.size();
+            curProgress = std::min(curProgress + static_cast<int>(100/commands.size() * foldedCommands), 100);
             listItem->setValue(std::to_string(curProgress) + "%", tsl::PredefinedColors::Green);
             //log("q%s", ss.str().c_str());
             
         }
     }
+    clearDirectoryCache();
+    saveContentIndex();
+    releaseCopyBuffers();
+    if (fingerprinted && getAppliedFingerprint(commands, optionKey, stateHash)) {
+        saveAppliedFingerprint(optionKey, stateHash);
+    }
     return 0;
 }
 
@@ -718,6 +1164,10 @@ void MTinterpretAndExecute(void* args){
     std::string progress = threadArgs->progress;
     std::vector<std::vector<std::string>> commands = threadArgs->commands;
     *errCode = interpretAndExecuteCommand(commands, progress, listItem);
+    // Also after a command that failed halfway
+    clearDirectoryCache();
+    saveContentIndex();
+    releaseCopyBuffers();
     // Mark function as done
     if (*errCode == 0) {
         listItem->setValue("DONE", tsl::PredefinedColors::Green);
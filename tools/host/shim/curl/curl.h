@@ -0,0 +1,153 @@
+#pragma once
+// Host stand-in for libcurl: a URL is served from a local directory instead of the network.
+// "https://github.com/owner/repo/file.zip" is read from <http-root>/github.com/owner/repo/file.zip,
+// a missing file fails like an unreachable host.
+#include <cstdarg>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+typedef long long curl_off_t;
+
+typedef enum {
+    CURLE_OK = 0,
+    CURLE_FAILED_INIT = 2,
+    CURLE_URL_MALFORMAT = 3,
+    CURLE_WRITE_ERROR = 23,
+    CURLE_ABORTED_BY_CALLBACK = 42,
+    CURLE_REMOTE_FILE_NOT_FOUND = 78,
+} CURLcode;
+
+typedef enum {
+    CURLOPT_URL,
+    CURLOPT_WRITEFUNCTION,
+    CURLOPT_WRITEDATA,
+    CURLOPT_USERAGENT,
+    CURLOPT_NOPROGRESS,
+    CURLOPT_XFERINFODATA,
+    CURLOPT_XFERINFOFUNCTION,
+    CURLOPT_FOLLOWLOCATION,
+    CURLOPT_CAINFO,
+} CURLoption;
+
+#define CURL_GLOBAL_DEFAULT 3L
+
+typedef size_t (*curl_write_callback)(char* buffer, size_t size, size_t nitems, void* userdata);
+typedef int (*curl_xferinfo_callback)(void* clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow);
+
+typedef struct {
+    std::string url;
+    curl_write_callback writeFunction = nullptr;
+    void* writeData = nullptr;
+    bool noProgress = true;
+    curl_xferinfo_callback progressFunction = nullptr;
+    void* progressData = nullptr;
+} CURL;
+
+struct HostDownload {
+    std::string url;
+    std::string file;
+    CURLcode result;
+};
+
+inline std::string hostHttpRoot;
+inline std::vector<HostDownload> hostDownloads;
+
+inline CURLcode curl_global_init(long) { return CURLE_OK; }
+inline void curl_global_cleanup() {}
+inline CURL* curl_easy_init() { return new CURL(); }
+inline void curl_easy_cleanup(CURL* curl) { delete curl; }
+
+inline CURLcode curl_easy_setopt(CURL* curl, CURLoption option, ...) {
+    va_list args;
+    va_start(args, option);
+    switch (option) {
+        case CURLOPT_URL:
+            curl->url = va_arg(args, const char*);
+            break;
+        case CURLOPT_WRITEFUNCTION:
+            curl->writeFunction = reinterpret_cast<curl_write_callback>(va_arg(args, void*));
+            break;
+        case CURLOPT_WRITEDATA:
+            curl->writeData = va_arg(args, void*);
+            break;
+        case CURLOPT_NOPROGRESS:
+            curl->noProgress = va_arg(args, long) != 0;
+            break;
+        case CURLOPT_XFERINFODATA:
+            curl->progressData = va_arg(args, void*);
+            break;
+        case CURLOPT_XFERINFOFUNCTION:
+            curl->progressFunction = reinterpret_cast<curl_xferinfo_callback>(va_arg(args, void*));
+            break;
+        default:
+            break;
+    }
+    va_end(args);
+    return CURLE_OK;
+}
+
+// Maps a URL to <http-root>/<host>/<path>, dropping the scheme and query
+inline std::string hostPathFromUrl(const std::string& url) {
+    std::string path = url;
+    const size_t scheme = path.find("://");
+    if (scheme != std::string::npos) {
+        path.erase(0, scheme + 3);
+    }
+    const size_t query = path.find_first_of("?#");
+    if (query != std::string::npos) {
+        path.resize(query);
+    }
+    return hostHttpRoot + "/" + path;
+}
+
+inline CURLcode curl_easy_perform(CURL* curl) {
+    if (curl->url.empty() || !curl->writeFunction) {
+        return CURLE_URL_MALFORMAT;
+    }
+    const std::string path = hostPathFromUrl(curl->url);
+    FILE* file = hostHttpRoot.empty() ? nullptr : std::fopen(path.c_str(), "rb");
+    if (!file) {
+        hostDownloads.push_back({curl->url, path, CURLE_REMOTE_FILE_NOT_FOUND});
+        return CURLE_REMOTE_FILE_NOT_FOUND;
+    }
+    std::fseek(file, 0, SEEK_END);
+    const curl_off_t total = std::ftell(file);
+    std::fseek(file, 0, SEEK_SET);
+
+    CURLcode result = CURLE_OK;
+    curl_off_t done = 0;
+    char buffer[16384];
+    size_t bytesRead;
+    while ((bytesRead = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        if (curl->writeFunction(buffer, 1, bytesRead, curl->writeData) != bytesRead) {
+            result = CURLE_WRITE_ERROR;
+            break;
+        }
+        done += bytesRead;
+        if (!curl->noProgress && curl->progressFunction && curl->progressFunction(curl->progressData, total, done, 0, 0) != 0) {
+            result = CURLE_ABORTED_BY_CALLBACK;
+            break;
+        }
+    }
+    std::fclose(file);
+    hostDownloads.push_back({curl->url, path, result});
+    return result;
+}
+
+inline const char* curl_easy_strerror(CURLcode code) {
+    switch (code) {
+        case CURLE_OK:
+            return "No error";
+        case CURLE_URL_MALFORMAT:
+            return "URL using bad/illegal format or missing URL";
+        case CURLE_WRITE_ERROR:
+            return "Failed writing received data to disk/application";
+        case CURLE_ABORTED_BY_CALLBACK:
+            return "Operation was aborted by an application callback";
+        case CURLE_REMOTE_FILE_NOT_FOUND:
+            return "Remote file not found";
+        default:
+            return "Unknown error";
+    }
+}
@@ -0,0 +1,185 @@
+#pragma once
+// Host stand-in for the parts of libnx used by the interpreter and its helpers.
+// The SD card is expected at "sdmc:/" relative to the working directory (see uberhand_cli.cpp).
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <ctime>
+#include <condition_variable>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+typedef u32 Result;
+
+#define MAKERESULT(module, description) ((((module) & 0x1FF)) | ((description) & 0x1FFF) << 9)
+#define R_SUCCEEDED(res) ((res) == 0)
+#define R_FAILED(res) ((res) != 0)
+
+// NRO / NACP layout, used by getOverlayInfo()
+typedef struct {
+    u32 unused;
+    u32 mod_offset;
+    u8 padding[8];
+} NroStart;
+
+typedef struct {
+    u32 file_off;
+    u32 size;
+} NroSegment;
+
+typedef struct {
+    u32 magic;
+    u32 unk1;
+    u32 size;
+    u32 unk2;
+    NroSegment segments[3];
+    u32 bss_size;
+    u32 unk3;
+    u8 build_id[0x20];
+    u8 padding[0x20];
+} NroHeader;
+
+typedef struct {
+    u64 offset;
+    u64 size;
+} NroAssetSection;
+
+typedef struct {
+    u32 magic;
+    u32 version;
+    NroAssetSection icon;
+    NroAssetSection nacp;
+    NroAssetSection romfs;
+} NroAssetHeader;
+
+typedef struct {
+    char name[0x200];
+    char author[0x100];
+} NacpLanguageEntry;
+
+typedef struct {
+    NacpLanguageEntry lang[16];
+    u8 reserved_x3000[0x60];
+    char display_version[0x10];
+    u8 reserved_x3070[0xF90];
+} NacpStruct;
+
+// time
+typedef enum {
+    TimeType_UserSystemClock,
+    TimeType_NetworkSystemClock,
+    TimeType_LocalSystemClock,
+    TimeType_Default = TimeType_UserSystemClock,
+} TimeType;
+
+inline Result timeGetCurrentTime(TimeType, u64* timestamp) {
+    *timestamp = static_cast<u64>(std::time(nullptr));
+    return 0;
+}
+
+// spl, the hardware type is chosen on the command line
+typedef enum {
+    SplConfigItem_HardwareType = 15,
+} SplConfigItem;
+
+inline u64 hostHardwareType = 1; // Copper (Erista)
+
+inline Result splInitialize() { return 0; }
+inline void splExit() {}
+inline Result splGetConfig(SplConfigItem, u64* out) {
+    *out = hostHardwareType;
+    return 0;
+}
+
+// fs, paths are relative to the SD card root
+typedef struct {
+    int unused;
+} FsFileSystem;
+
+inline Result fsOpenSdCardFileSystem(FsFileSystem*) { return 0; }
+inline void fsFsClose(FsFileSystem*) {}
+inline Result fsFsCommit(FsFileSystem*) { return 0; }
+
+inline Result fsFsDeleteDirectoryRecursively(FsFileSystem*, const char* path) {
+    std::error_code error;
+    return std::filesystem::remove_all(std::string("sdmc:") + path, error) > 0 && !error ? 0 : 1;
+}
+
+inline Result fsFsDeleteFile(FsFileSystem*, const char* path) {
+    std::error_code error;
+    return std::filesystem::remove(std::string("sdmc:") + path, error) && !error ? 0 : 1;
+}
+
+inline int fsdevUnmountAll() { return 0; }
+
+// spsm, a reboot or shutdown request is only reported
+inline int hostShutdownRequests = 0;
+
+inline Result spsmShutdown(bool reboot) {
+    std::fprintf(stderr, "[host] %s requested\n", reboot ? "reboot" : "shutdown");
+    ++hostShutdownRequests;
+    return 0;
+}
+
+// Synchronization and threads
+typedef struct {
+    std::mutex handle;
+} Mutex;
+
+inline void mutexInit(Mutex*) {}
+inline void mutexLock(Mutex* m) { m->handle.lock(); }
+inline void mutexUnlock(Mutex* m) { m->handle.unlock(); }
+
+typedef struct {
+    std::condition_variable_any handle;
+} CondVar;
+
+inline void condvarInit(CondVar*) {}
+inline Result condvarWait(CondVar* c, Mutex* m) {
+    c->handle.wait(m->handle);
+    return 0;
+}
+inline Result condvarWakeOne(CondVar* c) {
+    c->handle.notify_one();
+    return 0;
+}
+inline Result condvarWakeAll(CondVar* c) {
+    c->handle.notify_all();
+    return 0;
+}
+
+typedef void (*ThreadFunc)(void*);
+
+typedef struct {
+    ThreadFunc entry;
+    void* arg;
+    std::thread handle;
+} Thread;
+
+inline Result threadCreate(Thread* t, ThreadFunc entry, void* arg, void*, size_t, int, int) {
+    t->entry = entry;
+    t->arg = arg;
+    return 0;
+}
+inline Result threadStart(Thread* t) {
+    t->handle = std::thread(t->entry, t->arg);
+    return 0;
+}
+inline Result threadWaitForExit(Thread* t) {
+    if (t->handle.joinable()) {
+        t->handle.join();
+    }
+    return 0;
+}
+inline Result threadClose(Thread* t) { return threadWaitForExit(t); }
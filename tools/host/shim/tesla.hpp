@@ -0,0 +1,60 @@
+#pragma once
+// Host stand-in for the libtesla types referenced by utils.hpp
+#include <cstdio>
+#include <string>
+
+namespace tsl {
+
+    enum class FocusDirection {
+        None,
+        Up,
+        Down,
+        Left,
+        Right
+    };
+
+    enum class PredefinedColors {
+        Green,
+        Red,
+        White,
+        Orange,
+        Gray,
+        DefaultText
+    };
+
+    namespace elm {
+
+        class Element {
+        public:
+            virtual ~Element() = default;
+        };
+
+        class ListItem : public Element {
+        public:
+            ListItem(const std::string& text, const std::string& value = "") : m_text(text), m_value(value) {}
+
+            void setValue(const std::string& value, PredefinedColors = PredefinedColors::Gray) {
+                m_value = value;
+            }
+            const std::string& getValue() { return m_value; }
+            const std::string& getText() { return m_text; }
+
+        private:
+            std::string m_text;
+            std::string m_value;
+        };
+
+    }
+
+    class Gui {
+    public:
+        virtual ~Gui() = default;
+        elm::Element* getTopElement() { return nullptr; }
+        void requestFocus(elm::Element*, FocusDirection) {}
+    };
+
+    namespace impl {
+        inline void parseOverlaySettings() {}
+    }
+
+}
@@ -0,0 +1,98 @@
+#!/bin/sh
+# Runs the options of the Fixture package on a copy of tests/sd, one after the other, and compares what
+# uberhand-cli prints with expected.txt. Build the CLI first. With --update expected.txt is rewritten.
+here=$(cd "$(dirname "$0")" && pwd)
+cli="$here/../uberhand-cli"
+if [ ! -x "$cli" ]; then
+    echo "Build uberhand-cli first: make -C tools/host" >&2
+    exit 2
+fi
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+cp -R "$here/sd" "$work/sd"
+
+# Prints the command and its output without the parts that differ from run to run: durations, log times
+# and the caches in /config/uberhand/store/
+run() {
+    echo "\$ uberhand-cli $*"
+    status=0
+    "$cli" --sd "$work/sd" --package Fixture "$@" >"$work/output" 2>&1 || status=$?
+    sed -e 's/ in [0-9.]* ms$//' -e 's/^  log: \[[^]]*\] /  log: /' -e '/\/config\/uberhand\/store\//d' -e 's/^sdmc://' "$work/output"
+    echo "exit $status"
+    echo
+}
+
+# Prints a file from the SD card, or only its lines that contain the second argument
+show() {
+    echo "--- $1"
+    grep -e "${2:-}" "$work/sd$1" || echo "(missing)"
+    echo
+}
+
+tests() {
+    run
+
+    # Templates and calc
+    run --option "Calc"
+    run --option "Calc Overflow"
+    run --option "Calc Skip"
+    show /atmosphere/kips/loader.kip CUST
+
+    # Glob patterns and deletes
+    run --option "Glob"
+    run --option "Nested Delete"
+
+    # Control flow
+    run --option "Control"
+    show /out/flags.ini
+    show /switch/.packages/Fixture/configs/two.ini
+    run --option "Control" --hw mariko
+    run --option "Broken Block"
+    show /out/flags.ini
+
+    # Batched INI edits
+    run --option "Ini Batch"
+    show /out/batch.ini
+
+    # Copy engine
+    run --option "Mirror"
+    run --option "Mirror"
+    run --option "Mirror Delete"
+    run --option "Verified Copy"
+    run --option "Apply Once" --repeat 2
+
+    # Catalogs of JSON lists, read with the stream reader, and current value lookups
+    run --option "*Speed" --list
+    run --option "*Speed" --item 1
+    run --option "*Speed" --list
+    show /atmosphere/kips/loader.kip CUST
+    run --option "*Mode" --list
+    run --option "*Mode" --item 2
+    run --option "*Mode" --list
+    show /config/fixture/mode.ini
+
+    # File lists with filters
+    run --option "*Fonts" --list
+    run --option "*Fonts" --item "/switch/.packages/Fixture/assets/fonts/Bold [1].ttf"
+
+    # Backups, stored in full or as deltas
+    run --option "Backup"
+    run --option "*Speed" --item 2
+    run --option "Backup"
+    run --option "Backup"
+    run --option "*Backups" --list
+    run --option "*Backup Files" --list
+    run --option "*Backup Files" --item "/atmosphere/kips/.bak/Backup [2].delta"
+    show "/out/restored/Backup [2].kip" CUST
+}
+
+tests >"$work/actual" 2>&1
+if [ "$1" = "--update" ]; then
+    cp "$work/actual" "$here/expected.txt"
+    echo "Updated $here/expected.txt"
+elif diff -u "$here/expected.txt" "$work/actual"; then
+    echo "All fixture runs match"
+else
+    exit 1
+fi
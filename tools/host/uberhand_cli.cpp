@@ -0,0 +1,422 @@
+// Headless runner for package options on a host machine.
+//
+// The directory given with --sd stands in for the SD card: a work directory with an "sdmc:"
+// symlink to it becomes the current directory, so every "sdmc:/..." path used by the helpers
+// resolves there unchanged. Downloads are served from --http-root by the curl stand-in.
+#include <switch.h>
+#include <tesla.hpp>
+#include <utils.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <map>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+struct FileState {
+    bool directory;
+    uintmax_t size;
+    uint64_t hash;
+};
+
+using Snapshot = std::map<std::string, FileState>;
+
+const std::string logFileRelativePath = "config/uberhand/log.txt";
+
+void printUsage() {
+    std::fprintf(stderr,
+        "Usage: uberhand-cli --sd <dir> (--package <name|dir> | --config <file>) [options]\n"
+        "\n"
+        "  --sd <dir>          directory used as the SD card root\n"
+        "  --package <name>    package in /switch/.packages/ on the SD card, or a package directory\n"
+        "  --config <file>     config.ini to read the options from\n"
+        "  --option <name>     option to run; without it the options are listed\n"
+        "  --item <value>      selected item for '*' options (index for json_source, path otherwise)\n"
+        "  --toggle on|off     state to switch to for source_on/source_off and toggle_state options\n"
+        "  --http-root <dir>   serve downloads from <dir>/<host>/<path>\n"
+        "  --hw erista|mariko  hardware type reported to '; Mariko' / '; Erista' sections (default erista)\n"
+        "  --repeat <n>        run the option n times and time each run (default 1)\n"
+        "  --list              print the items a '*' option offers instead of running it\n"
+        "  --no-diff           don't report filesystem changes\n");
+}
+
+uint64_t hashFile(const std::string& path) {
+    uint64_t hash = fnv1aOffsetBasis;
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return hash;
+    }
+    char buffer[65536];
+    size_t bytesRead;
+    while ((bytesRead = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        hash = fnv1aHash(buffer, bytesRead, hash);
+    }
+    fclose(file);
+    return hash;
+}
+
+Snapshot takeSnapshot() {
+    Snapshot snapshot;
+    std::error_code error;
+    for (auto it = fs::recursive_directory_iterator("sdmc:/", error); !error && it != fs::recursive_directory_iterator(); it.increment(error)) {
+        const std::string relativePath = it->path().lexically_relative("sdmc:/").generic_string();
+        if (relativePath == logFileRelativePath) {
+            continue;
+        }
+        if (it->is_directory()) {
+            snapshot[relativePath + "/"] = {true, 0, 0};
+        } else {
+            snapshot[relativePath] = {false, it->file_size(), hashFile(it->path().string())};
+        }
+    }
+    return snapshot;
+}
+
+void printDiff(const Snapshot& before, const Snapshot& after) {
+    size_t changes = 0;
+    for (const auto& [path, state] : after) {
+        auto it = before.find(path);
+        if (it == before.end()) {
+            std::printf("  + /%s\n", path.c_str());
+            ++changes;
+        } else if (!state.directory && (state.size != it->second.size || state.hash != it->second.hash)) {
+            std::printf("  ~ /%s (%ju -> %ju bytes)\n", path.c_str(), it->second.size, state.size);
+            ++changes;
+        }
+    }
+    for (const auto& [path, state] : before) {
+        if (after.find(path) == after.end()) {
+            std::printf("  - /%s\n", path.c_str());
+            ++changes;
+        }
+    }
+    if (changes == 0) {
+        std::printf("  (no changes)\n");
+    }
+}
+
+uintmax_t getLogSize() {
+    std::error_code error;
+    const uintmax_t size = fs::file_size("sdmc:/" + logFileRelativePath, error);
+    return error ? 0 : size;
+}
+
+// Prints what the helpers logged since offset
+void printLogSince(uintmax_t offset) {
+    FILE* file = fopen(("sdmc:/" + logFileRelativePath).c_str(), "r");
+    if (!file) {
+        return;
+    }
+    fseek(file, offset, SEEK_SET);
+    char line[4096];
+    while (fgets(line, sizeof(line), file)) {
+        std::fprintf(stderr, "  log: %s", line);
+    }
+    fclose(file);
+}
+
+std::string getDisplayName(const std::string& optionName) {
+    std::string name = optionName;
+    if (!name.empty() && (name[0] == '*' || name[0] == '-' || name[0] == '@' || name[0] == '>')) {
+        name.erase(0, 1);
+    }
+    for (const char* suffix : {" ;; ", " - "}) {
+        const size_t pos = name.find(suffix);
+        if (pos != std::string::npos) {
+            name.resize(pos);
+        }
+    }
+    return name;
+}
+
+// Builds the command list the overlay would run for the option, following SubMenu and SelectionOverlay
+bool prepareCommands(const std::pair<std::string, std::vector<std::vector<std::string>>>& option, const std::string& item, const std::string& toggle, std::vector<std::vector<std::string>>& commands) {
+    const auto& optionCommands = option.second;
+    std::string pathReplaceOn, pathReplaceOff;
+    bool usingJsonSource = false, useToggleState = false;
+    for (const auto& cmd : optionCommands) {
+        if (cmd.empty()) {
+            continue;
+        }
+        if (cmd[0] == "json_source" || cmd[0] == "json_mark_cur_kip" || cmd[0] == "json_mark_cur_ini") {
+            usingJsonSource = true;
+        } else if (cmd[0] == "source_on" && cmd.size() > 1) {
+            pathReplaceOn = cmd[1];
+        } else if (cmd[0] == "source_off" && cmd.size() > 1) {
+            pathReplaceOff = cmd[1];
+        } else if (cmd[0] == "toggle_state") {
+            useToggleState = true;
+        }
+    }
+
+    if (option.first[0] == '*') {
+        if (item.empty()) {
+            std::fprintf(stderr, "Option \"%s\" needs a selected item, use --item\n", option.first.c_str());
+            return false;
+        }
+        const std::string file = (item[0] == '/') ? preprocessPath(item) : item;
+        if (usingJsonSource) {
+            commands = getModifyCommands(optionCommands, file, false, true, true);
+        } else if (!pathReplaceOn.empty() || !pathReplaceOff.empty()) {
+            commands = getModifyCommands(optionCommands, file, true, toggle != "off");
+        } else {
+            commands = getModifyCommands(optionCommands, getBackupViewPath(file));
+        }
+        return true;
+    }
+
+    if (useToggleState || !pathReplaceOn.empty() || !pathReplaceOff.empty()) {
+        if (toggle != "on" && toggle != "off") {
+            std::fprintf(stderr, "Option \"%s\" is a toggle, use --toggle on|off\n", option.first.c_str());
+            return false;
+        }
+        if (useToggleState) {
+            const std::string prefix = (toggle == "on") ? "toggle_on" : "toggle_off";
+            std::vector<std::vector<std::string>> toggleCommands;
+            for (const auto& cmd : optionCommands) {
+                if (!cmd.empty() && cmd[0] == prefix) {
+                    toggleCommands.emplace_back(cmd.begin() + 1, cmd.end());
+                }
+            }
+            commands = getModifyCommands(toggleCommands, "", false, true, true);
+        } else if (toggle == "on") {
+            commands = getModifyCommands(optionCommands, pathReplaceOn, true);
+        } else {
+            commands = getModifyCommands(optionCommands, pathReplaceOff, true, false);
+        }
+        return true;
+    }
+
+    commands = optionCommands;
+    return true;
+}
+
+// Prints the items SelectionOverlay would list for a '*' option, the current one of a JSON list marked with
+// "(current)". Returns false if the option has no list.
+bool printItems(const std::vector<std::vector<std::string>>& optionCommands) {
+    std::vector<std::string> filterList;
+    std::string pathPattern, jsonPath, jsonKey = "name", offset, sourceIni, sectionIni, keyIni;
+    bool useSource = false, useJson = false, useKipInfo = false, markCurKip = false, markCurIni = false;
+    for (const auto& cmd : optionCommands) {
+        if (cmd.size() < 2) {
+            continue;
+        }
+        // The console resolves paths without "sdmc:" on the SD card, here they need it
+        if (cmd[0] == "filter") {
+            filterList.push_back(cmd[1][0] == '/' ? preprocessPath(cmd[1]) : cmd[1]);
+        } else if (cmd[0] == "source") {
+            pathPattern = preprocessPath(cmd[1]);
+            useSource = true;
+        } else if (cmd[0] == "kip_info") {
+            useKipInfo = true;
+        } else if (cmd[0] == "json_source" || cmd[0] == "json_mark_cur_kip" || cmd[0] == "json_mark_cur_ini") {
+            jsonPath = preprocessPath(cmd[1]);
+            if (cmd.size() > 2) {
+                jsonKey = cmd[2];
+            }
+            useJson = true;
+            if (cmd[0] == "json_mark_cur_kip" && cmd.size() > 3) {
+                offset = cmd[3];
+                markCurKip = true;
+            } else if (cmd[0] == "json_mark_cur_ini" && cmd.size() > 5) {
+                sourceIni = preprocessPath(cmd[3]);
+                sectionIni = cmd[4];
+                keyIni = cmd[5];
+                markCurIni = true;
+            }
+        }
+    }
+
+    const GlobExclusions filters(filterList);
+    std::vector<std::string> items;
+    if (useJson) {
+        // Same catalog and current value lookup as the overlay's list
+        enum { NameColumn, HexColumn, DecColumn, ValueColumn };
+        auto catalog = getCatalog(jsonPath, {jsonKey, "hex", "dec", "value"});
+        if (!catalog) {
+            std::fprintf(stderr, "Can't read \"%s\" as a list\n", jsonPath.c_str());
+            return false;
+        }
+        const JsonTable& table = catalog->table;
+        long currentRow = -1;
+        for (size_t row = 0; row < table.rows && (markCurKip || markCurIni); ++row) {
+            const bool hasHex = table.has(row, HexColumn), hasDec = table.has(row, DecColumn);
+            if (!table.has(row, NameColumn) || !(hasHex || hasDec || (markCurIni && table.has(row, ValueColumn)))) {
+                continue;
+            }
+            const int column = hasHex ? HexColumn : (hasDec ? DecColumn : ValueColumn);
+            std::string currentValue;
+            size_t offsetValue;
+            if (!markCurKip) {
+                currentValue = readIniValue(sourceIni, sectionIni, keyIni);
+            } else if (parseOffset(offset, offsetValue)) {
+                const int hexLength = hasHex ? std::max(static_cast<int>(table.get(row, HexColumn).size() / 2), 1) : 4;
+                currentValue = readHexDataAtOffset(backupKipPath, "43555354", offsetValue, hexLength);
+                if (!hasHex && !currentValue.empty()) {
+                    currentValue = std::to_string(reversedHexToInt(currentValue));
+                }
+            }
+            if (!currentValue.empty()) {
+                currentRow = catalog->find(column, currentValue);
+            }
+            break;
+        }
+        for (size_t row = 0; row < table.rows; ++row) {
+            const std::string name(table.has(row, NameColumn) ? table.get(row, NameColumn) : "");
+            if (!name.empty() && !filters.excludes(name)) {
+                items.push_back(static_cast<long>(row) == currentRow ? name + " (current)" : name);
+            }
+        }
+    } else if (useSource && useKipInfo && isBackupListPattern(pathPattern)) {
+        items = listBackups(pathPattern, filters);
+    } else if (useSource) {
+        items = getFilesListByWildcards(pathPattern, filters);
+        sortPathsByName(items);
+    } else {
+        std::fprintf(stderr, "The option has no list\n");
+        return false;
+    }
+    for (const auto& itemText : items) {
+        std::printf("%s\n", itemText.c_str());
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::string sdRoot, package, configPath, optionName, item, toggle, httpRoot;
+    std::string hardware = "erista";
+    int repeat = 1;
+    bool showDiff = true;
+    bool listItems = false;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                std::fprintf(stderr, "Missing value for %s\n", arg.c_str());
+                std::exit(2);
+            }
+            return argv[++i];
+        };
+        if (arg == "--sd") {
+            sdRoot = value();
+        } else if (arg == "--package") {
+            package = value();
+        } else if (arg == "--config") {
+            configPath = value();
+        } else if (arg == "--option") {
+            optionName = value();
+        } else if (arg == "--item") {
+            item = value();
+        } else if (arg == "--toggle") {
+            toggle = value();
+        } else if (arg == "--http-root") {
+            httpRoot = value();
+        } else if (arg == "--hw") {
+            hardware = value();
+        } else if (arg == "--repeat") {
+            repeat = std::max(1, std::atoi(value().c_str()));
+        } else if (arg == "--no-diff") {
+            showDiff = false;
+        } else if (arg == "--list") {
+            listItems = true;
+        } else {
+            printUsage();
+            return 2;
+        }
+    }
+    if (sdRoot.empty() || (package.empty() && configPath.empty()) || (hardware != "erista" && hardware != "mariko")) {
+        printUsage();
+        return 2;
+    }
+
+    std::error_code error;
+    sdRoot = fs::canonical(sdRoot, error).string();
+    if (error || !fs::is_directory(sdRoot)) {
+        std::fprintf(stderr, "SD root \"%s\" is not a directory\n", sdRoot.c_str());
+        return 2;
+    }
+    if (!httpRoot.empty()) {
+        hostHttpRoot = fs::absolute(httpRoot).string();
+    }
+    if (!configPath.empty()) {
+        configPath = fs::absolute(configPath).string();
+    } else if (package.find('/') != std::string::npos) {
+        configPath = (fs::absolute(package) / configFileName).string();
+    }
+    hostHardwareType = (hardware == "mariko") ? 4 : 1;
+
+    // Map sdmc:/ to the SD root
+    char workTemplate[] = "/tmp/uberhand-cli-XXXXXX";
+    const char* workDir = mkdtemp(workTemplate);
+    if (!workDir || symlink(sdRoot.c_str(), (std::string(workDir) + "/sdmc:").c_str()) != 0 || chdir(workDir) != 0) {
+        std::fprintf(stderr, "Failed to set up the work directory\n");
+        return 2;
+    }
+    createDirectory(settingsPath);
+    if (configPath.empty()) {
+        configPath = packageDirectory + package + "/" + configFileName;
+    }
+
+    int exitCode = 0;
+    if (!isFileOrDirectory(configPath)) {
+        std::fprintf(stderr, "No config at %s\n", configPath.c_str());
+        exitCode = 2;
+    } else {
+        auto options = loadOptionsFromIni(configPath);
+        auto option = options.end();
+        for (auto it = options.begin(); it != options.end(); ++it) {
+            if (optionName.empty()) {
+                if (it->second.empty() || it->second[0].empty() || it->second[0][0] != "separator") {
+                    std::printf("%s\n", it->first.c_str());
+                }
+            } else if (it->first == optionName || getDisplayName(it->first) == optionName) {
+                option = it;
+                break;
+            }
+        }
+
+        std::vector<std::vector<std::string>> commands;
+        if (optionName.empty()) {
+            // Options listed
+        } else if (option == options.end()) {
+            std::fprintf(stderr, "No option \"%s\" in %s\n", optionName.c_str(), configPath.c_str());
+            exitCode = 2;
+        } else if (listItems) {
+            exitCode = printItems(option->second) ? 0 : 2;
+        } else if (!prepareCommands(*option, item, toggle, commands)) {
+            exitCode = 2;
+        } else {
+            for (int run = 1; run <= repeat; ++run) {
+                const Snapshot before = showDiff ? takeSnapshot() : Snapshot();
+                const uintmax_t logOffset = getLogSize();
+                hostDownloads.clear();
+
+                // Same call the option's list item makes on the console
+                tsl::elm::ListItem listItem(getDisplayName(option->first));
+                const auto start = std::chrono::steady_clock::now();
+                const int result = interpretAndExecuteCommand(commands, "temp", &listItem);
+                const auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+                std::printf("run %d: %s in %.3f ms\n", run, result == -1 ? "FAIL" : (result == 1 ? "DONE (back)" : "DONE"), elapsed);
+                printLogSince(logOffset);
+                for (const auto& download : hostDownloads) {
+                    std::printf("  download %s -> %s\n", download.url.c_str(), download.result == CURLE_OK ? "ok" : curl_easy_strerror(download.result));
+                }
+                if (showDiff) {
+                    printDiff(before, takeSnapshot());
+                }
+                if (result == -1) {
+                    exitCode = 1;
+                    break;
+                }
+            }
+        }
+    }
+
+    fs::remove(std::string(workDir) + "/sdmc:", error);
+    fs::remove(workDir, error);
+    return exitCode;
+}